@@ -0,0 +1,68 @@
+/**
+ * @file bench.hpp
+ * @brief 基准测试的公共工具。
+ * @details 每个基准测试是一个单独的 xmake 目标，名字以 bench_ 开头，默认不编译，需要时单独编译运行：
+ *
+ * ```shell
+ * xmake f -m release
+ * xmake build bench_crc && xmake run bench_crc
+ * ```
+ */
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <print>
+#include <string_view>
+
+#include "utils/utils.hpp"
+
+namespace roboctrl::bench{
+
+using namespace std::chrono_literals;
+
+/**
+ * @brief 纳秒，带小数，单次操作的耗时往往不到 1ns。
+ */
+using nanoseconds = std::chrono::duration<double,std::nano>;
+
+/**
+ * @brief 阻止编译器把没有用到的结果优化掉。
+ */
+template<typename T>
+inline void keep(const T& value){
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+ * @brief 测量 fn 每次调用的平均耗时。
+ * @details 先调用几次预热，之后每一轮把调用次数加倍，直到一轮的总耗时超过 min_time。
+ */
+template<typename Fn>
+nanoseconds measure(Fn&& fn,std::chrono::nanoseconds min_time = 200ms){
+    for(int i = 0; i < 16; ++i)
+        fn();
+
+    for(std::size_t n = 16;; n *= 2){
+        auto begin = utils::now();
+        for(std::size_t i = 0; i < n; ++i)
+            fn();
+        auto elapsed = utils::now() - begin;
+
+        if(elapsed >= min_time)
+            return nanoseconds{elapsed} / static_cast<double>(n);
+    }
+}
+
+/**
+ * @brief 输出一项结果。
+ * @param bytes 每次操作处理的字节数，不为 0 时同时输出吞吐量
+ */
+inline void report(std::string_view name,nanoseconds per_op,std::size_t bytes = 0){
+    if(bytes)
+        std::println("{:<48} {:>10.1f} ns/op {:>10.1f} MB/s", name, per_op.count(), static_cast<double>(bytes) / per_op.count() * 1e3);
+    else
+        std::println("{:<48} {:>10.1f} ns/op", name, per_op.count());
+}
+
+}
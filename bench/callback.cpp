@@ -0,0 +1,52 @@
+/**
+ * @file callback.cpp
+ * @brief 同步回调与协程回调的分发开销对比。
+ * @details 同步回调在 callback::operator() 中直接调用；协程回调每次都要分配协程帧、提交到任务上下文，
+ * 这里把任务上下文跑到空闲为止，计入回调真正执行完的时间。
+ */
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "bench.hpp"
+#include "core/async.hpp"
+#include "utils/callback.hpp"
+
+using namespace roboctrl;
+
+int main(){
+    roboctrl::init(task_context::info_type{});
+    auto& context = roboctrl::get<task_context>().asio_context();
+
+    std::array<std::byte,8> frame{};
+    std::span<std::byte> data{frame};
+    std::uint64_t sum = 0;
+
+    for(int subscribers : {1, 4}){
+        callback<std::span<std::byte>> sync;
+        callback<std::span<std::byte>> async;
+
+        for(int i = 0; i < subscribers; ++i){
+            sync.add([&](std::span<std::byte> bytes){
+                sum += std::to_integer<std::uint8_t>(bytes[0]);
+            });
+            async.add([&](std::span<std::byte> bytes) -> awaitable<void>{
+                sum += std::to_integer<std::uint8_t>(bytes[0]);
+                co_return;
+            });
+        }
+
+        bench::report(std::format("sync callback, {} subscriber(s)", subscribers), bench::measure([&]{
+            sync(data);
+        }));
+
+        bench::report(std::format("coroutine callback, {} subscriber(s)", subscribers), bench::measure([&]{
+            async(data);
+            context.restart();
+            context.poll();
+        }));
+    }
+
+    bench::keep(sum);
+}
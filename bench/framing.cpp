@@ -0,0 +1,106 @@
+/**
+ * @file framing.cpp
+ * @brief TCP 回环上各种分帧方式的吞吐量。
+ * @details 客户端连续发送固定大小的消息，服务端的连接统计收到的字节数和帧数。stream_framing::none 即不分帧的读取路径，
+ * 每次读到的数据原样分发，消息会被拆开或者粘在一起，只能统计字节数；u32 和 varint 会逐帧分发完整的消息。
+ * 发送端最多领先接收端 window 条消息，保证发送队列不会溢出。
+ */
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "bench.hpp"
+#include "core/async.hpp"
+#include "io/framing.hpp"
+#include "io/tcp.h"
+
+using namespace roboctrl;
+using namespace roboctrl::io;
+
+static constexpr std::size_t __window = 512;
+
+static std::string_view __framing_name(stream_framing framing){
+    switch(framing){
+        case stream_framing::u32:
+            return "u32";
+        case stream_framing::varint:
+            return "varint";
+        default:
+            return "none";
+    }
+}
+
+/**
+ * 在一种分帧方式下发送 count 条 size 字节的消息，输出吞吐量。
+ */
+static awaitable<void> __run(stream_framing framing,std::size_t size,std::size_t count,std::uint16_t port){
+    std::size_t received_bytes = 0;
+    std::size_t received_frames = 0;
+    std::shared_ptr<tcp> connection;
+
+    auto& server = roboctrl::get(tcp_server::info_type{
+        .name = std::format("server_{}_{}", __framing_name(framing), size),
+        .address = "127.0.0.1",
+        .port = port,
+        .framing = framing
+    });
+    server.on_connect([&](std::shared_ptr<tcp> conn){
+        connection = conn;
+        conn->on_data([&](byte_span data){
+            received_bytes += data.size();
+            ++received_frames;
+        });
+    });
+
+    auto& client = roboctrl::get(tcp::info_type{
+        .name = std::format("client_{}_{}", __framing_name(framing), size),
+        .address = "127.0.0.1",
+        .port = port,
+        .tx = {.depth = 2 * __window},
+        .framing = framing
+    });
+
+    while(!connection)
+        co_await roboctrl::yield();
+
+    std::vector<std::byte> message(size);
+    auto total = size * count;
+    auto begin = utils::now();
+
+    for(std::size_t sent = 0; sent < count; ++sent){
+        while((sent * size - received_bytes) / size >= __window)
+            co_await roboctrl::yield();
+        co_await client.send(byte_span{message});
+    }
+    while(received_bytes < total)
+        co_await roboctrl::yield();
+
+    auto elapsed = bench::nanoseconds{utils::now() - begin};
+    bench::report(std::format("{}B messages, framing {} ({} callbacks)", size, __framing_name(framing), received_frames),
+        elapsed / static_cast<double>(count), size);
+
+    if(client.stats().tx_dropped)
+        std::println("  {} messages dropped by the send queue", client.stats().tx_dropped);
+
+    client.close();
+    while(connection->is_open())
+        co_await roboctrl::yield();
+}
+
+static awaitable<void> __main(){
+    std::uint16_t port = 47100;
+    for(auto [size, count] : {std::pair<std::size_t,std::size_t>{64, 200000}, {1024, 50000}}){
+        for(auto framing : {stream_framing::none, stream_framing::u32, stream_framing::varint})
+            co_await __run(framing, size, count, port++);
+    }
+    roboctrl::stop();
+}
+
+int main(){
+    roboctrl::init(task_context::info_type{});
+    roboctrl::spawn(__main());
+    roboctrl::run();
+}
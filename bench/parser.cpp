@@ -0,0 +1,75 @@
+/**
+ * @file parser.cpp
+ * @brief combined_parser 的拆帧吞吐量。
+ * @details 把同一段数据按不同大小切块喂给解析器，模拟每次读取只拿到一部分数据的情况。
+ * 块越小，跨越两次读取、需要暂存的帧越多。
+ */
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bench.hpp"
+#include "io/base.hpp"
+#include "utils/concepts.hpp"
+#include "utils/crc.hpp"
+
+using namespace roboctrl;
+using namespace roboctrl::utils::byte_literals;
+
+static constexpr std::size_t __frames = 1000;
+
+/**
+ * 生成 __frames 帧 `0xAA 0x55`、1 字节长度、数据、CRC16 格式的数据。
+ */
+static std::vector<std::byte> __make_stream(std::size_t payload){
+    std::vector<std::byte> stream;
+    for(std::size_t i = 0; i < __frames; ++i){
+        auto begin = stream.size();
+        stream.push_back(0xAA_b);
+        stream.push_back(0x55_b);
+        stream.push_back(static_cast<std::byte>(payload));
+        for(std::size_t j = 0; j < payload; ++j)
+            stream.push_back(static_cast<std::byte>(i + j));
+
+        auto crc = utils::crc16::compute(std::span{stream}.subspan(begin));
+        stream.push_back(static_cast<std::byte>(crc & 0xff));
+        stream.push_back(static_cast<std::byte>(crc >> 8));
+    }
+    return stream;
+}
+
+int main(){
+    using parser_type = io::combined_parser<
+        io::fixed_data<0xAA_b,0x55_b>,
+        io::length_data<std::uint8_t>,
+        io::other_all,
+        io::checksum_data<utils::crc16>
+    >;
+
+    for(std::size_t payload : {16, 64, 200}){
+        auto stream = __make_stream(payload);
+        parser_type parser;
+
+        for(std::size_t chunk : {stream.size(), std::size_t{64}, std::size_t{7}, std::size_t{1}}){
+            std::size_t frames = 0;
+            auto per_pass = bench::measure([&]{
+                for(std::size_t i = 0; i < stream.size(); i += chunk){
+                    auto size = std::min(chunk, stream.size() - i);
+                    frames += parser.feed(io::byte_span{stream.data() + i, size}, [](io::byte_span frame){
+                        bench::keep(frame);
+                    });
+                }
+            });
+
+            auto name = chunk == stream.size()
+                ? std::format("{}B payload, whole buffer", payload)
+                : std::format("{}B payload, {}B reads", payload, chunk);
+            bench::report(name, per_pass / __frames, stream.size() / __frames);
+            bench::keep(frames);
+        }
+
+        if(parser.failures())
+            std::println("unexpected parse failures: {}", parser.failures());
+    }
+}
@@ -0,0 +1,88 @@
+/**
+ * @file scatter_gather.cpp
+ * @brief 合并系统调用带来的开销差别。
+ * @details 对比 IO 在一个控制周期中发出多帧时的两种写法：每一帧（每一段）一次系统调用，
+ * 以及 send(std::span<const byte_span>) / send_batch() 使用的 writev()、sendmmsg() 一次写出。
+ * 数据写到 /dev/null 和本机的 UDP 回环端口，只测量系统调用本身的开销，不需要任何硬件。
+ */
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+
+using namespace roboctrl;
+
+int main(){
+    // 裸 IO：一帧由帧头、数据、校验三段组成
+    int null_fd = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if(null_fd < 0){
+        std::perror("open /dev/null");
+        return 1;
+    }
+
+    std::array<std::byte,4> header{};
+    std::array<std::byte,32> payload{};
+    std::array<std::byte,2> trailer{};
+    std::array<::iovec,3> parts{{
+        {header.data(), header.size()},
+        {payload.data(), payload.size()},
+        {trailer.data(), trailer.size()}
+    }};
+    auto frame_size = header.size() + payload.size() + trailer.size();
+
+    bench::report("3 parts, 3 x write()", bench::measure([&]{
+        for(auto& part : parts)
+            bench::keep(::write(null_fd, part.iov_base, part.iov_len));
+    }), frame_size);
+
+    bench::report("3 parts, 1 x writev()", bench::measure([&]{
+        bench::keep(::writev(null_fd, parts.data(), parts.size()));
+    }), frame_size);
+
+    ::close(null_fd);
+
+    // 带键值 IO：一个控制周期发出 4 帧，与 dji_motor_group 的指令帧数量相当
+    int sock = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    int sink = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    ::sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::socklen_t addr_len = sizeof(addr);
+    if(sock < 0 || sink < 0 ||
+        ::bind(sink, reinterpret_cast<::sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::getsockname(sink, reinterpret_cast<::sockaddr*>(&addr), &addr_len) < 0 ||
+        ::connect(sock, reinterpret_cast<::sockaddr*>(&addr), sizeof(addr)) < 0){
+        std::perror("udp loopback");
+        return 1;
+    }
+
+    // 对端不读取，接收缓冲满后内核直接丢弃报文，发送端不受影响
+    constexpr std::size_t batch = 4;
+    std::array<std::array<std::byte,16>,batch> frames{};
+    std::array<::iovec,batch> iovs;
+    std::array<::mmsghdr,batch> msgs{};
+    for(std::size_t i = 0; i < batch; ++i){
+        iovs[i] = {frames[i].data(), frames[i].size()};
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    bench::report(std::format("{} frames, {} x send()", batch, batch), bench::measure([&]{
+        for(auto& frame : frames)
+            bench::keep(::send(sock, frame.data(), frame.size(), MSG_DONTWAIT));
+    }), batch * frames[0].size());
+
+    bench::report(std::format("{} frames, 1 x sendmmsg()", batch), bench::measure([&]{
+        bench::keep(::sendmmsg(sock, msgs.data(), msgs.size(), MSG_DONTWAIT));
+    }), batch * frames[0].size());
+
+    ::close(sock);
+    ::close(sink);
+}
@@ -0,0 +1,83 @@
+/**
+ * @file shm.cpp
+ * @brief 共享内存与 UDP 回环的往返延迟。
+ * @details 发送端每次发出一条消息，等对端原样发回后再发下一条，统计往返时间的分布。
+ * 共享内存的对端是同一进程中以 create = false 打开的另一个 shm；UDP 的对端是任务上下文中的一个回显 socket。
+ * 两边的回显都在同一个任务上下文中执行，差别只在传输本身。
+ */
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "bench.hpp"
+#include "core/async.hpp"
+#include "io/shm.h"
+#include "io/udp.h"
+
+using namespace roboctrl;
+using namespace roboctrl::io;
+
+static constexpr std::size_t __count = 20000;
+static constexpr std::uint16_t __udp_port = 47200;
+
+template<typename IO>
+static awaitable<void> __ping(std::string_view name,IO& io,std::size_t size){
+    std::vector<std::chrono::nanoseconds> samples;
+    samples.reserve(__count);
+    bool received = false;
+    io.on_data([&](byte_span){ received = true; });
+
+    std::vector<std::byte> message(size);
+    for(std::size_t i = 0; i < __count; ++i){
+        received = false;
+        auto begin = utils::now();
+        co_await io.send(byte_span{message});
+        while(!received)
+            co_await roboctrl::yield();
+        samples.push_back(utils::now() - begin);
+    }
+
+    std::ranges::sort(samples);
+    auto percentile = [&](double p){
+        return bench::nanoseconds{samples[static_cast<std::size_t>(p * (samples.size() - 1))]}.count() / 1e3;
+    };
+    std::println("{:<32} p50 {:>8.1f} us  p99 {:>8.1f} us  max {:>8.1f} us",
+        std::format("{} {}B round trip", name, size), percentile(0.5), percentile(0.99), percentile(1));
+}
+
+static awaitable<void> __udp_echo(asio::ip::udp::socket& socket){
+    std::array<std::byte,2048> buffer;
+    asio::ip::udp::endpoint from;
+    while(true){
+        auto n = co_await socket.async_receive_from(asio::buffer(buffer), from, asio::use_awaitable);
+        co_await socket.async_send_to(asio::buffer(buffer.data(), n), from, asio::use_awaitable);
+    }
+}
+
+static awaitable<void> __main(){
+    auto& a = roboctrl::get(shm::info_type{.key_ = "bench_a", .path = "/roboctrl_bench_shm", .create = true, .capacity = 1 << 16});
+    auto& b = roboctrl::get(shm::info_type{.key_ = "bench_b", .path = "/roboctrl_bench_shm", .create = false});
+    b.on_data([&b](byte_span data){
+        roboctrl::spawn(b.send(data));
+    });
+
+    static asio::ip::udp::socket echo{roboctrl::executor(), {asio::ip::make_address("127.0.0.1"), __udp_port}};
+    roboctrl::spawn(__udp_echo(echo));
+    auto& u = roboctrl::get(udp::info_type{.key_ = "bench_udp", .address = "127.0.0.1", .port = __udp_port});
+
+    for(std::size_t size : {64, 1024}){
+        co_await __ping("shm", a, size);
+        co_await __ping("udp", u, size);
+    }
+
+    roboctrl::stop();
+}
+
+int main(){
+    roboctrl::init(task_context::info_type{});
+    roboctrl::spawn(__main());
+    roboctrl::run();
+}
@@ -263,8 +263,14 @@ inline auto desc(const descable auto& owner) -> std::string{
     return owner.desc();
 }
 
+/**
+ * @brief 获取某个多例类的全部实例
+ * 
+ * @tparam owner_type 多例类类型
+ * @return 从key到实例的映射
+ */
 template<owner owner_type>
-auto instances(){
+auto& instances(){
     return details::multiton_impl<owner_type>::instances;
 }
 
@@ -6,9 +6,9 @@
 #pragma once
 
 #include <array>
-#include <span>
 
 #include "device/base.hpp"
+#include "utils/latest.hpp"
 
 namespace roboctrl::device{ 
     
@@ -24,28 +24,38 @@ enum class axis : std::size_t {
     z = 2,
 };
 
+/**
+ * @brief IMU 的一次测量值。
+ */
+struct imu_state{
+    std::array<fp32, 3> acc {};     ///< 三轴加速度
+    std::array<fp32, 3> gyro {};    ///< 三轴角速度
+    std::array<fp32, 3> angle {};   ///< 欧拉角
+};
+
 /**
  * @brief IMU 基类，封装常见数据通道。
+ * @details 测量值通过 utils::latest 发布，读取时返回的是拷贝，可以安全地在其他线程中读取。
  */
 struct imu_base : public device_base {
 protected:
-    std::array<fp32, 3> acc_ {};
-    std::array<fp32, 3> gyro_ {};
-    std::array<fp32, 3> angle_ {};
+    utils::latest<imu_state> state_; ///< 由 IO 回调发布的测量值
 
 public:
+    /** @brief 获取最新的测量值及其时间戳、序号。 */
+    auto state() const { return state_.read(); }
     /** @brief 获取三轴加速度。(rad/s^2) */
-    auto acc() const { return std::span{ acc_ }; }
+    auto acc() const { return state_.value().acc; }
     /** @brief 获取三轴角速度。(rad/s)*/
-    auto gyro() const { return std::span{ gyro_ }; }
+    auto gyro() const { return state_.value().gyro; }
     /** @brief 获取欧拉角。(rad) */
-    auto angle() const { return std::span{ angle_ }; }
+    auto angle() const { return state_.value().angle; }
     /** @brief 指定轴的加速度。 */
-    fp32 acc(const axis axis) const { return acc_[std::to_underlying(axis)]; }
+    fp32 acc(const axis axis) const { return acc()[std::to_underlying(axis)]; }
     /** @brief 指定轴的角速度。 */
-    fp32 gyro(const axis axis) const { return gyro_[std::to_underlying(axis)]; }
+    fp32 gyro(const axis axis) const { return gyro()[std::to_underlying(axis)]; }
     /** @brief 指定轴的欧拉角。 */
-    fp32 angle(const axis axis) const { return angle_[std::to_underlying(axis)]; }
+    fp32 angle(const axis axis) const { return angle()[std::to_underlying(axis)]; }
 
     inline explicit imu_base(const std::chrono::nanoseconds offline_timeout) : device_base{offline_timeout} {}
 };
@@ -19,6 +19,7 @@
 #include "core/multiton.hpp"
 #include "device/base.hpp"
 #include "utils/controller.hpp"
+#include "utils/latest.hpp"
 #include "utils/utils.hpp"
 #include "io/base.hpp"
 
@@ -60,48 +61,61 @@ inline motor_measure parse_motor_upload_pkg(io::byte_span data)
 }
 /// @endcond 
 
+/**
+ * @brief 电机的一次测量值。
+ */
+struct motor_state{
+    fp32 angle = 0;         ///< 角度（rad）
+    fp32 angle_speed = 0;   ///< 角速度（rad/s）
+    fp32 torque = 0;        ///< 扭矩（A）
+};
+
 struct motor_base : public device_base {
 protected:
-    float angle_ {}; //rad
-    float angle_speed_ {}; //rad/s
-    float torque_ {}; // A
+    utils::latest<motor_state> state_; ///< 由 IO 回调发布的测量值
     float radius_ {}; // m
 
 public:
+    /**
+     * @brief 获取最新的测量值及其时间戳、序号
+     * @details 一次读出的角度、角速度、扭矩来自同一次测量。控制循环可以比较序号判断电机有没有新的反馈。
+     */
+    inline auto state() const { return state_.read(); }
+
     /**
      * @brief 获取电机角度（单位为rad）
      * 
      * @return 电机角度（单位为rad）
      */
-    inline fp32 angle() const { return angle_; }
+    inline fp32 angle() const { return state_.value().angle; }
     
     /**
      * @brief 获取电机角速度（单位为rad/s）
      * 
      * @return fp32 电机角速度（单位为rad/s）
      */
-    inline fp32 angle_speed() const { return angle_speed_; }
+    inline fp32 angle_speed() const { return state_.value().angle_speed; }
 
     /**
      * @brief 获取电机转速（单位为rpm）
      * 
      * @return fp32 电机转速（单位为rpm）
      */
-    inline fp32 rpm() const { return angle_speed_ * 60.f / (2.f * Pi_f); }
+    inline fp32 rpm() const { return angle_speed() * 60.f / (2.f * Pi_f); }
     
     /**
      * @brief 获取电机扭矩（单位为A）
      * 
      * @return fp32 电机扭矩（单位为A）
      */
-    inline fp32 torque() const { return torque_; }
+    inline fp32 torque() const { return state_.value().torque; }
     
     /**
      * @brief 获取电机线速度（单位为m/s）
      * 
      * @return fp32 电机线速度（单位为m/s）
      */
-    inline fp32 linear_speed() const { return angle_speed_ * radius_; }
+    inline fp32 linear_speed() const { return angle_speed() * radius_; }
     
     /**构造函数
     * @param offline_timeout 电机离线超时时间
@@ -5,9 +5,13 @@
  */
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include "base.hpp"
 #include "core/logger.h"
@@ -68,7 +72,8 @@ private:
 private:
     friend dji_motor_group;
     info_type info_;
-    int16_t current_;
+    dji_motor_group* group_;
+    int16_t current_ = 0;
     fp32 reduction_ratio_;
     utils::linear_pid pid_;
 };
@@ -89,6 +94,8 @@ public:
         using owner_type = dji_motor_group;
 
         std::string_view can_name;
+        std::chrono::microseconds period = 1ms;    ///< 指令帧的发送周期
+        unsigned int watchdog = 20;                ///< CAN_BCM 模式下连续这么多个周期没有调用 update() 时停止周期发送，0 表示不检查
 
         inline std::string_view key()const{return can_name;}
 
@@ -103,10 +110,24 @@ public:
     dji_motor_group(info_type info);
 
     /**
-     * @brief 与调度器协同的任务，负责读取反馈等。
+     * @brief 析构时停止 CAN_BCM 中的周期帧，电机不会在分组析构后继续收到最后的电流指令。
+     */
+    ~dji_motor_group();
+
+    /**
+     * @brief 与调度器协同的任务，周期性地发送指令帧。
+     * @details CAN 开启了 CAN_BCM（见 io::can::info_type::bcm）时，指令帧交给内核周期发送，
+     * 之后只在电机的电流变化时通过 update() 更新内核中的数据。这时这个任务只作为看门狗：
+     * 连续 info_type::watchdog 个周期没有调用 update()（电机反馈中断或者控制卡住）时，停止内核中的全部周期帧，
+     * 下一次 update() 时再重新启动。
      */
     awaitable<void> task();
 
+    /**
+     * @brief 每次收到电机反馈、算出新的电流后调用，在 CAN_BCM 模式下更新对应的指令帧并喂看门狗。
+     */
+    void update(const dji_motor& motor);
+
     /**
      * @brief 注册单个电机到分组内。
      */
@@ -114,7 +135,15 @@ public:
     inline std::string desc()const{return std::format("Dji motor group on can({})",info_.can_name);}
 
 private:
-    awaitable<void> send_command(uint16_t can_id_);
+    /**
+     * @brief 生成指定 CAN ID 的电流指令帧，这个 ID 下没有电机时返回 false。
+     */
+    bool build_command(uint16_t can_id_, std::array<std::byte,8>& data);
+
+    /**
+     * @brief 停止 CAN_BCM 中的全部周期帧。
+     */
+    void stop_cyclic();
 private:
 
     struct motor_info{
@@ -125,6 +154,8 @@ private:
 
     std::vector<dji_motor*> motors_;
     info_type info_;
+    std::unordered_map<uint16_t,std::array<std::byte,8>> cyclic_payloads_; ///< CAN_BCM 模式下内核中正在发送的数据
+    std::chrono::nanoseconds last_update_{0};   ///< 最后一次调用 update() 的时间，见 utils::now()
 };
 
 static_assert(multiton_info<dji_motor_group::info_type>);
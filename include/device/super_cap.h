@@ -3,9 +3,19 @@
 
 #include "core/async.hpp"
 #include "device/base.hpp"
+#include "utils/latest.hpp"
 #include "utils/singleton.hpp"
 
 namespace roboctrl::device{
+/**
+ * @brief 超级电容的一次反馈。
+ */
+struct super_cap_state{
+    float chassis_power = 0;            ///< 底盘功率
+    uint16_t chassis_power_limit = 0;   ///< 功率限制
+    uint8_t energy = 0;                 ///< 超电能量
+};
+
 /**
 * @brief 超极电容
 */
@@ -27,24 +37,27 @@ public:
      */
     awaitable<void> set(bool enable,uint16_t power_limit);
 
+    /**
+     * @brief 最新的反馈及其时间戳、序号
+     */
+    inline auto state()const{return state_.read();}
+
     /**
      * @brief 当前底盘功率
      */
-    inline float chassis_power()const{return chassis_power_;}
+    inline float chassis_power()const{return state_.value().chassis_power;}
     /**
      * @brief 当前功率限制
      */
-    inline uint16_t chassis_power_limit()const{return chassis_power_limit_;}
+    inline uint16_t chassis_power_limit()const{return state_.value().chassis_power_limit;}
 
     /**
      * @brief 当前超电能量
      */
-    inline uint8_t energy()const{return energy_;}
+    inline uint8_t energy()const{return state_.value().energy;}
 private:
     info_type info_;
-    float chassis_power_;
-    uint16_t chassis_power_limit_;
-    uint8_t energy_;
+    utils::latest<super_cap_state> state_;
 };
 
 static_assert(utils::singleton<super_cap>);
@@ -14,17 +14,23 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <concepts>
 #include <cstddef>
 #include <cstring>
+#include <functional>
+#include <limits>
 #include <span>
 #include <tuple>
 #include <type_traits>
 #include <map>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include "core/async.hpp"
+#include "io/frame_pool.h"
+#include "io/stats.hpp"
 #include "utils/callback.hpp"
 #include "utils/utils.hpp"
 #include "utils/concepts.hpp"
@@ -32,30 +38,74 @@
 namespace roboctrl::io{
 
 /**
- * @brief 数据指针，实际上是一个std::shared_ptr<std::vector<std::byte>>;
+ * @brief 数据指针，实际上是一个来自 frame_pool 的带引用计数的帧缓冲，见 roboctrl::io::frame_buffer 。
  */
-using data_ptr = std::shared_ptr<std::vector<std::byte>>;
+using data_ptr = frame_buffer;
 
 /**
  * @brief byte span，实际上就是一个std::span<std::byte>;
  */
 using byte_span = std::span<std::byte>;
 
+/**
+ * @brief IO 的抓包回调，参数依次为 key 的字节（裸 IO 为空）、收到的数据和接收时间。
+ * @details 用于 roboctrl::io::capture 录制收到的全部数据。接收时间与分发时的 rx_time() 相同，
+ * 使用内核时间戳的 IO 录下的也是内核时间戳。
+ */
+using tap_fn = std::function<void(std::span<const std::byte>,std::span<const std::byte>,std::chrono::nanoseconds)>;
+
+class replay;
+
 /**
  * @brief 将任意满足 byte_container 的数据拷贝到共享缓冲。
+ * @details 缓冲从当前线程的 frame_pool 中取得，稳态下不会产生堆分配。
  * @param t 输入缓冲
  */
 template<utils::byte_container T>
 data_ptr make_shared_from(const T& t) {
-    auto res = std::make_shared<std::vector<std::byte>>(t.size());
+    auto res = frame_pool::local().acquire(t.size());
     if (t.size() > 0)
-        std::memcpy(res->data(), t.data(), t.size());
+        std::memcpy(res.data(), t.data(), t.size());
     return res;
 }
 
-/**
- * @brief 裸IO组件。
- */
+/// @cond INTERNAL
+namespace details{
+
+// 把字节回调包装成接收 data_ptr 的回调。协程回调是惰性执行的，必须让协程帧持有 data_ptr，
+// 否则帧缓冲在协程真正运行前就会被归还到池中。
+template<typename Fn>
+auto bind_data(Fn fn){
+    if constexpr (std::same_as<std::invoke_result_t<Fn&, byte_span>, awaitable<void>>)
+        return [fn = std::move(fn)](data_ptr data) mutable -> awaitable<void> {
+            co_await fn(data.span());
+        };
+    else
+        return [fn = std::move(fn)](data_ptr data) mutable {
+            fn(data.span());
+        };
+}
+
+// 把平凡类型包的回调包装成字节回调，同样让协程帧持有反序列化后的包。
+template<typename Fn>
+auto bind_package(Fn fn){
+    using pkg_type = std::remove_cvref_t<utils::function_arg_t<Fn>>;
+    static_assert(roboctrl::utils::package<pkg_type>);
+
+    if constexpr (std::same_as<std::invoke_result_t<Fn&, const pkg_type&>, awaitable<void>>)
+        return [fn = std::move(fn)](byte_span bytes) mutable -> awaitable<void> {
+            auto pkg = utils::from_bytes<pkg_type>(bytes);
+            co_await fn(pkg);
+        };
+    else
+        return [fn = std::move(fn)](byte_span bytes) mutable {
+            fn(utils::from_bytes<pkg_type>(bytes));
+        };
+}
+
+}
+/// @endcond
+
 /**
  * @brief 裸数据 IO 基类，仅根据字节流处理事件。
  */
@@ -70,21 +120,14 @@ public:
      * @brief 注册字节级别的回调。
      */
     inline void on_data(callback_fn<byte_span> auto fn){
-        callback_.add([fn](data_ptr data) mutable -> auto {
-            return fn(std::span{data->data(), data->size()});
-        });
+        callback_.add(details::bind_data(std::move(fn)));
     }
 
     template<typename Fn>
     requires (!std::same_as<utils::function_arg_t<Fn>,byte_span>)
     inline void on_data(Fn&& fn)
     {
-        using Arg = utils::function_arg_t<Fn>;
-        static_assert(roboctrl::utils::package<std::remove_cvref_t<Arg>>);
-
-        on_data([fn = std::forward<Fn>(fn)](byte_span bytes) mutable {
-            return fn(utils::from_bytes<std::remove_cvref_t<Arg>>(bytes));
-        });
+        on_data(details::bind_package(std::forward<Fn>(fn)));
     }
 
     template<roboctrl::utils::package T>
@@ -95,40 +138,159 @@ public:
     inline awaitable<void> send(const T& data){
         co_await send(utils::to_bytes(data));
     }
+
+    /**
+     * @brief 获取统计信息。
+     */
+    inline const io_stats& stats() const { return stats_; }
+
+    /**
+     * @brief 设置抓包回调，每次分发数据前都会调用。传入空函数取消抓包。
+     */
+    inline void set_tap(tap_fn tap){ tap_ = std::move(tap); }
+
+    /**
+     * @brief 正在分发的数据的接收时间，程序启动后的纳秒数，见 utils::now()。
+     * @details 只在同步回调中有意义，协程回调执行时可能已经在分发下一帧了。
+     */
+    inline std::chrono::nanoseconds rx_time() const { return rx_time_; }
 protected:
+    friend replay;
+
     /**
      * @brief 分发收到的字节流。
      * @param bytes 接收到的缓冲
      */
     inline void dispatch(byte_span bytes){
+        dispatch(bytes, utils::now());
+    }
+
+    /**
+     * @brief 分发收到的字节流，并指定接收时间（例如内核的接收时间戳）。
+     */
+    inline void dispatch(byte_span bytes,std::chrono::nanoseconds rx_time){
+        rx_time_ = rx_time;
+        if(tap_)
+            tap_({}, bytes, rx_time_);
+
+        ++stats_.traffic.rx_frames;
+        stats_.traffic.rx_bytes += bytes.size();
+
+        if(callback_.empty()){
+            ++stats_.unknown_keys;
+            return;
+        }
 
         callback_(make_shared_from(bytes));
+        stats_.latency.record(utils::now() - rx_time);
+    }
+
+    /**
+     * @brief 记录一次成功的发送。
+     */
+    inline void record_tx(std::size_t bytes){
+        ++stats_.traffic.tx_frames;
+        stats_.traffic.tx_bytes += bytes;
     }
 
+    /**
+     * @brief 记录一次发送失败。
+     */
+    inline void record_send_error(){ ++stats_.send_errors; }
+
+    /**
+     * @brief 记录一次因为发送队列已满而丢弃的帧。
+     */
+    inline void record_tx_drop(){ ++stats_.tx_dropped; }
+
+    /**
+     * @brief 记录因为接收队列已满而丢弃的帧。
+     */
+    inline void record_rx_drop(std::uint64_t frames = 1){ stats_.rx_dropped += frames; }
+
+    /**
+     * @brief 记录解析失败。
+     */
+    inline void record_parse_failure(std::uint64_t count = 1){ stats_.parse_failures += count; }
+
 private:
     callback<data_ptr> callback_;
+    io_stats stats_;
+    tap_fn tap_;
+    std::chrono::nanoseconds rx_time_{0};
+};
+
+/**
+ * @brief 带 key 的 IO 中，每个 key 对应的槽位。
+ */
+struct key_slot{
+    callback<data_ptr> callbacks;   ///< 这个 key 的全部回调
+    std::size_t size = 0;           ///< 注册时给出的包大小，0 表示未知
+    traffic_stats traffic;          ///< 这个 key 的流量统计
+};
+
+/**
+ * @brief key 表概念。
+ * @details 带 key 的 IO 通过 key 表找到 key 对应的槽位。find() 在 key 不存在时返回空指针，
+ * emplace() 在 key 不存在时创建一个空槽位，for_each() 遍历所有槽位。槽位一旦创建，地址在 key 表的生命周期内不能改变。
+ */
+template<typename T, typename TK>
+concept key_table = requires (T t, const TK& key){
+    {t.find(key)} -> std::same_as<key_slot*>;
+    {t.emplace(key)} -> std::same_as<key_slot&>;
+    t.for_each([](const TK&,key_slot&){});
+};
+
+/**
+ * @brief 基于 std::map 的默认 key 表，适用于字符串等稀疏的 key。
+ */
+template<typename TK>
+class map_key_table{
+public:
+    inline key_slot* find(const TK& key){
+        auto it = slots_.find(key);
+        return it == slots_.end() ? nullptr : &it->second;
+    }
+
+    inline key_slot& emplace(const TK& key){
+        return slots_[key];
+    }
+
+    template<typename Fn>
+    void for_each(Fn&& fn){
+        for(auto& [key,slot] : slots_)
+            fn(key,slot);
+    }
+
+private:
+    std::map<TK,key_slot> slots_;
 };
 
 /**
  * @brief 带 key 的 IO 基类，根据键值派发数据。
  * @tparam TK 键类型
+ * @tparam Table key 表类型，默认使用 std::map，对于 CAN ID 等稠密的 key 可以换成直接索引的表
  */
-template<typename TK>
+template<typename TK, key_table<TK> Table = map_key_table<TK>>
 class keyed_io_base
     :public utils::immovable_base, 
     public utils::not_copyable_base
 {
 public:
+    using table_type = Table;
+
     inline keyed_io_base(){};
 
     /**
      * @brief 注册指定 key 的回调。
      */
     void on_data(const TK& key,callback_fn<byte_span> auto fn,size_t size = 0){
-        sizes_[key] = size;
-        callbacks_[key].add([fn](data_ptr data) mutable -> auto{
-            return fn(std::span{data->data(),data->size()});
-        });
+        auto& slot = table_.emplace(key);
+        slot.size = size;
+        slot.callbacks.add(details::bind_data(std::move(fn)));
+
+        if(register_hook_)
+            register_hook_(key);
     }
 
     /**
@@ -139,30 +301,154 @@ public:
     inline void on_data(const TK& key,Fn&& fn)
     {
         using Arg = utils::function_arg_t<Fn>;
-        static_assert(roboctrl::utils::package<std::remove_cvref_t<Arg>>);
-        
-        on_data(key,[fn = std::forward<Fn>(fn)](byte_span bytes) mutable {
-            return fn(utils::from_bytes<std::remove_cvref_t<Arg>>(bytes));
-        },sizeof(Arg));
+        on_data(key,details::bind_package(std::forward<Fn>(fn)),sizeof(Arg));
+    }
+
+    /**
+     * @brief 获取统计信息。
+     */
+    inline const io_stats& stats() const { return stats_; }
+
+    /**
+     * @brief 获取指定 key 的流量统计，key 从未注册过回调时返回空指针。
+     * @details 注册过回调但还没有收发过数据的 key 返回计数为 0 的统计。
+     */
+    inline const traffic_stats* key_stats(const TK& key){
+        auto slot = table_.find(key);
+        return slot ? &slot->traffic : nullptr;
+    }
+
+    /**
+     * @brief 遍历所有 key 的流量统计。
+     * @param fn 接受 `(const TK&, const traffic_stats&)` 的函数
+     */
+    template<typename Fn>
+    void for_each_key_stats(Fn&& fn){
+        table_.for_each([&](const TK& key,key_slot& slot){
+            fn(key,std::as_const(slot.traffic));
+        });
     }
+
+    /**
+     * @brief 设置抓包回调，每次分发数据前都会调用。传入空函数取消抓包。
+     * @details 只有平凡类型的 key 才能被抓包。
+     */
+    inline void set_tap(tap_fn tap)
+        requires utils::package<TK>
+    {
+        tap_ = std::move(tap);
+    }
+
+    /**
+     * @brief 正在分发的数据的接收时间，程序启动后的纳秒数，见 utils::now()。
+     * @details 只在同步回调中有意义，协程回调执行时可能已经在分发下一帧了。设备可以用它作为测量值的采样时间。
+     */
+    inline std::chrono::nanoseconds rx_time() const { return rx_time_; }
 protected:
+    friend replay;
+
     /**
      * @brief 将数据派发给对应 key 的回调。
      */
     inline void dispatch(const TK& key,byte_span data){
-        auto pd = make_shared_from(data);
-        if(callbacks_.contains(key)){
-            callbacks_.at(key)(pd);
+        dispatch(key, data, utils::now());
+    }
+
+    /**
+     * @brief 将数据派发给对应 key 的回调，并指定接收时间（例如内核的接收时间戳）。
+     */
+    inline void dispatch(const TK& key,byte_span data,std::chrono::nanoseconds rx_time){
+        rx_time_ = rx_time;
+        if constexpr (utils::package<TK>){
+            if(tap_)
+                tap_(std::as_bytes(std::span{&key,1}), data, rx_time_);
         }
+
+        ++stats_.traffic.rx_frames;
+        stats_.traffic.rx_bytes += data.size();
+
+        auto slot = table_.find(key);
+        if(!slot || slot->callbacks.empty()){
+            ++stats_.unknown_keys;
+            return;
+        }
+
+        // 注册的是平凡类型的包时，多余的数据（例如 CAN FD 的填充字节）截掉，不够长的帧直接丢弃
+        if(slot->size != 0){
+            if(data.size() < slot->size){
+                ++stats_.parse_failures;
+                return;
+            }
+            data = data.first(slot->size);
+        }
+
+        ++slot->traffic.rx_frames;
+        slot->traffic.rx_bytes += data.size();
+        slot->callbacks(make_shared_from(data));
+        stats_.latency.record(utils::now() - rx_time);
+    }
+
+    /**
+     * @brief 设置注册回调时的钩子，每次通过 on_data() 注册回调后都会以对应的 key 调用。
+     * @details 派生类可以借此根据已注册的 key 配置底层设备，例如 can 据此生成内核过滤器。
+     */
+    inline void set_register_hook(std::function<void(const TK&)> hook){
+        register_hook_ = std::move(hook);
+    }
+
+    /**
+     * @brief 遍历所有注册了回调的 key。
+     */
+    template<typename Fn>
+    void for_each_registered_key(Fn&& fn){
+        table_.for_each([&](const TK& key,key_slot& slot){
+            if(!slot.callbacks.empty())
+                fn(key);
+        });
     }
 
     inline size_t package_size(const TK& key){
-        return sizes_[key];
+        auto slot = table_.find(key);
+        return slot ? slot->size : 0;
     }
 
+    /**
+     * @brief 记录一次指定 key 的成功发送。
+     */
+    inline void record_tx(const TK& key,std::size_t bytes){
+        auto& slot = table_.emplace(key);
+        ++slot.traffic.tx_frames;
+        slot.traffic.tx_bytes += bytes;
+        ++stats_.traffic.tx_frames;
+        stats_.traffic.tx_bytes += bytes;
+    }
+
+    /**
+     * @brief 记录一次发送失败。
+     */
+    inline void record_send_error(){ ++stats_.send_errors; }
+
+    /**
+     * @brief 记录一次因为发送队列已满而丢弃的帧。
+     */
+    inline void record_tx_drop(){ ++stats_.tx_dropped; }
+
+    /**
+     * @brief 记录因为接收队列已满而丢弃的帧。
+     */
+    inline void record_rx_drop(std::uint64_t frames = 1){ stats_.rx_dropped += frames; }
+
+    /**
+     * @brief 记录解析失败。
+     */
+    inline void record_parse_failure(std::uint64_t count = 1){ stats_.parse_failures += count; }
+
 private:
-    std::map<TK,callback<data_ptr>> callbacks_;
-    std::map<TK,size_t> sizes_;
+    Table table_;
+    io_stats stats_;
+    tap_fn tap_;
+    std::chrono::nanoseconds rx_time_{0};
+    std::function<void(const TK&)> register_hook_;
 };
 
 /**
@@ -178,76 +464,311 @@ concept bare_io = std::is_base_of_v<bare_io_base, T> && requires (T t){
  * @brief 带 key 的 IO 概念，要求具备 send/task 协程接口。
  */
 template<typename T>
-concept keyed_io = std::is_base_of_v<keyed_io_base<typename T::key_type>, T> && requires (T t) {
+concept keyed_io = requires {
     typename T::key_type;
+    typename T::table_type;
+} && std::is_base_of_v<keyed_io_base<typename T::key_type, typename T::table_type>, T> && requires (T t) {
     {t.task()} -> std::same_as<awaitable<void>>;
     {t.send(std::declval<typename T::key_type>(),std::declval<byte_span>())} -> std::same_as<awaitable<void>>;
 };
 
 /**
- * @brief 数据解析器概念，负责按需消费字节并返回结果。
+ * @brief 变长解析器的大小标记。
+ * @details 变长解析器的长度由前面的长度解析器（见 length_parser）决定；如果前面没有长度解析器，
+ * 则吃掉这一帧中除了尾部定长字段以外的全部数据，适用于 UDP 这样自带边界的 IO。
+ */
+inline constexpr std::size_t dynamic_size = std::numeric_limits<std::size_t>::max();
+
+/**
+ * @brief 数据解析器概念，描述帧中的一个字段。
+ * @details 每个解析器用静态成员 size 声明自己占用的字节数（或 dynamic_size）。parse() 的 frame 参数是这一帧中
+ * 位于这个字段之前的全部字节，field 参数是这个字段本身的字节，返回 false 表示这一帧无效。
  */
 template<typename T>
-concept data_parser = requires (T t,byte_span bytes){
+concept data_parser = requires (T t,byte_span frame,byte_span field){
     typename T::data_type;
-    {t.parse(std::declval<size_t>(),bytes)} -> std::same_as<std::size_t>;
+    {T::size} -> std::convertible_to<std::size_t>;
+    {t.parse(frame,field)} -> std::same_as<bool>;
     {t.data()} -> std::same_as<typename T::data_type>;
 };
 
 /**
- * @brief 组合式解析器，可顺序堆叠多个数据解析单元。
+ * @brief 长度解析器概念，解析出的 length() 决定后面变长字段的长度。
+ */
+template<typename T>
+concept length_parser = data_parser<T> && requires (const T t){
+    {t.length()} -> std::convertible_to<std::size_t>;
+};
+
+/**
+ * @brief 校验算法概念，用于 checksum_data。
+ */
+template<typename T>
+concept checksum = requires (byte_span bytes){
+    typename T::value_type;
+    {T::compute(bytes)} -> std::same_as<typename T::value_type>;
+};
+
+/**
+ * @brief 解析状态。
+ */
+enum class parse_status{
+    complete,   ///< 解析出了完整的一帧
+    incomplete, ///< 数据不够，需要等待更多数据
+    invalid     ///< 数据无效，需要重新同步
+};
+
+/**
+ * @brief 组合式解析器，把多个数据解析单元按顺序拼成一个帧解析器。
+ * @details 每个字段的解析代码都在编译期展开。解析器是可恢复的：可以把任意切分的字节块依次喂给 feed()，
+ * 解析器会记住一帧解析到了哪个字段。如果一帧完整地落在输入块中，会直接在输入块上解析并回调，不拷贝数据；
+ * 只有跨越两次读取的帧，才会把已收到的部分暂存起来。
+ *
+ * 解析失败时，解析器会跳过一个字节重新同步；如果第一个字段是 fixed_data，会直接用 memchr 找到下一个可能的帧头。
+ * 从失去同步到再次解析出完整的一帧之间的连续错误数据只计一次失败，见 failures()。
+ *
+ * 示例：
+ *
+ * ```cpp
+ * combined_parser<fixed_data<0xAA_b,0x55_b>,length_data<uint8_t>,other_all> parser;
+ *
+ * parser.feed(bytes,[&](byte_span frame){
+ *     auto payload = parser.data<2>();
+ * });
+ * ```
  */
 template<data_parser... parser_types>
-struct combined_parser{
-    template<int N>
+class combined_parser{
+    static constexpr std::array<std::size_t,sizeof...(parser_types)> sizes_{parser_types::size...};
+
+    static_assert(std::ranges::count(sizes_,dynamic_size) <= 1, "combined_parser 中最多只能有一个变长解析器");
+
+    // 变长字段之后的定长字段的总长度
+    static constexpr std::size_t tail_size = []{
+        std::size_t tail = 0;
+        bool after = false;
+        for(auto size : sizes_){
+            if(after)
+                tail += size;
+            if(size == dynamic_size)
+                after = true;
+        }
+        return tail;
+    }();
+
+public:
+    template<std::size_t N>
     using parser_type = std::tuple_element_t<N,std::tuple<parser_types...>>;
 
-    template<int N>
+    template<std::size_t N>
     using data_type = typename parser_type<N>::data_type;
 
+    combined_parser() = default;
+
     /**
-     * @brief 依次执行所有解析器。
-     * @return 成功消费的字节数，0 表示解析失败
+     * @brief 用给定的解析器实例构造，适用于需要携带状态的解析器。
      */
-    size_t parse(byte_span data){
-        size_t pos = 0;
-        for(auto& parser : parsers){
-            size_t diff  = parser.parse(pos,data);
-
-            if(!diff)
-                return false;
+    explicit combined_parser(parser_types... parsers) : parsers_{std::move(parsers)...} {}
 
-            pos += diff;
+    /**
+     * @brief 喂入一段字节。
+     * @param chunk 新收到的字节，可以是任意长度
+     * @param on_frame 每解析出完整的一帧就调用一次，参数是这一帧的全部字节；回调中可以通过 data() 获取各字段
+     * @return 解析出的帧数
+     */
+    template<typename Fn>
+    requires std::invocable<Fn&,byte_span>
+    std::size_t feed(byte_span chunk,Fn&& on_frame){
+        std::size_t frames = 0;
+
+        while(!chunk.empty()){
+            if(pending_.empty()){
+                chunk = resync(chunk);
+                if(chunk.empty())
+                    break;
+
+                auto status = parse(chunk);
+                if(status == parse_status::complete){
+                    auto size = offset_;
+                    restart();
+                    synced_ = true;
+                    on_frame(chunk.first(size));
+                    chunk = chunk.subspan(size);
+                    ++frames;
+                }
+                else if(status == parse_status::invalid){
+                    lose_sync();
+                    restart();
+                    chunk = chunk.subspan(1);
+                }
+                else{
+                    // 帧跨越了两次读取，把已经收到的部分暂存起来，之后在暂存区上从头继续解析
+                    auto needed = needed_;
+                    restart();
+                    needed_ = needed;
+                    pending_.reserve(max_frame_size_);
+                    pending_.assign(chunk.begin(),chunk.end());
+                    chunk = {};
+                }
+                continue;
+            }
+
+            auto take = std::min(needed_ - pending_.size(),chunk.size());
+            pending_.insert(pending_.end(),chunk.begin(),chunk.begin() + take);
+            chunk = chunk.subspan(take);
+
+            auto status = parse(pending_);
+            if(status == parse_status::complete){
+                auto size = offset_;
+                restart();
+                synced_ = true;
+                on_frame(byte_span{pending_}.first(size));
+                pending_.clear();
+                ++frames;
+            }
+            else if(status == parse_status::invalid){
+                lose_sync();
+                restart();
+                std::vector<std::byte> rest;
+                rest.swap(pending_);
+                frames += feed(byte_span{rest}.subspan(1),on_frame);
+            }
         }
 
-        return pos;
+        return frames;
     }
 
     /**
      * @brief 获取指定序号解析器的解析结果。
      */
-    template<int N>
+    template<std::size_t N>
     auto data() -> data_type<N>{
-        return std::get<N>(parsers).data();
+        return std::get<N>(parsers_).data();
     }
 
-    std::tuple<parser_types...> parsers;
+    /**
+     * @brief 获取指定序号的解析器。
+     */
+    template<std::size_t N>
+    auto parser() -> parser_type<N>&{
+        return std::get<N>(parsers_);
+    }
+
+    /**
+     * @brief 解析失败（需要重新同步）的次数。
+     * @details 无效的帧和重新同步时跳过的字节都算作失败，但在下一次解析出完整的帧之前不会重复计数。
+     */
+    inline std::size_t failures() const { return failures_; }
+
+    /**
+     * @brief 设置一帧的最大长度，需要更多数据的帧会被当作无效帧，防止错误的长度字段让暂存区无限增长。
+     */
+    inline void set_max_frame_size(std::size_t size){ max_frame_size_ = size; }
+
+    /**
+     * @brief 丢弃暂存的数据，从头开始解析。
+     */
+    inline void reset(){
+        restart();
+        pending_.clear();
+        synced_ = true;
+    }
+
+private:
+    inline void lose_sync(){
+        if(synced_)
+            ++failures_;
+        synced_ = false;
+    }
+
+    inline void restart(){
+        field_ = 0;
+        offset_ = 0;
+        length_ = dynamic_size;
+        needed_ = 0;
+    }
+
+    template<std::size_t I>
+    parse_status step(byte_span frame){
+        using parser_t = parser_type<I>;
+        constexpr bool dynamic = parser_t::size == dynamic_size;
+
+        std::size_t size = parser_t::size;
+        if constexpr (dynamic){
+            if(length_ != dynamic_size)
+                size = length_;
+            else
+                size = frame.size() >= offset_ + tail_size ? frame.size() - offset_ - tail_size : 0;
+        }
+
+        // 变长字段要等尾部的定长字段一起到齐，这样一帧最多只需要等待一次
+        auto needed = offset_ + size + (dynamic ? tail_size : 0);
+        if(frame.size() < needed){
+            if(needed > max_frame_size_)
+                return parse_status::invalid;
+            needed_ = needed;
+            return parse_status::incomplete;
+        }
+
+        auto& parser = std::get<I>(parsers_);
+        if(!parser.parse(frame.first(offset_),frame.subspan(offset_,size)))
+            return parse_status::invalid;
+
+        if constexpr (length_parser<parser_t>)
+            length_ = static_cast<std::size_t>(parser.length());
+
+        offset_ += size;
+        field_ = I + 1;
+        return parse_status::complete;
+    }
+
+    parse_status parse(byte_span frame){
+        auto status = parse_status::complete;
+        [&]<std::size_t... I>(std::index_sequence<I...>){
+            ((I < field_ || (status = step<I>(frame)) == parse_status::complete) && ...);
+        }(std::index_sequence_for<parser_types...>{});
+        return status;
+    }
+
+    byte_span resync(byte_span bytes){
+        if constexpr (sizeof...(parser_types) > 0){
+            using first_type = parser_type<0>;
+            if constexpr (requires { first_type::bytes_data[0]; }){
+                auto found = std::memchr(bytes.data(),std::to_integer<int>(first_type::bytes_data[0]),bytes.size());
+                if(found != bytes.data())
+                    lose_sync();
+                if(!found)
+                    return {};
+                return bytes.subspan(static_cast<std::byte*>(found) - bytes.data());
+            }
+        }
+        return bytes;
+    }
+
+    std::tuple<parser_types...> parsers_;
+    std::size_t field_ = 0;
+    std::size_t offset_ = 0;
+    std::size_t length_ = dynamic_size;
+    std::size_t needed_ = 0;
+    std::size_t failures_ = 0;
+    bool synced_ = true;
+    std::size_t max_frame_size_ = 4096;
+    std::vector<std::byte> pending_;
 };
 
 /**
  * @brief 固定长度字节解析器。
  * @tparam N 需要解析的字节数
  */
-template<int N>
+template<std::size_t N>
 struct nbytes{
     using data_type = std::array<std::byte,N>;
 
-    std::size_t parse(byte_span bytes){
-        if(bytes.size() < N){
-            return 0;
-        }
-        std::copy_n(bytes.begin(), N, data_.begin());
-        return N;
+    static constexpr std::size_t size = N;
+
+    bool parse(byte_span,byte_span field){
+        std::copy_n(field.begin(), N, data_.begin());
+        return true;
     }
 
     data_type data(){
@@ -264,12 +785,11 @@ template<roboctrl::utils::package T>
 struct struct_data{
     using data_type = T;
 
-    std::size_t parse(byte_span bytes){
-        if(bytes.size() < sizeof(T)){
-            return 0;
-        }
-        std::memcpy(static_cast<void*>(&data_), static_cast<const void*>(bytes.data()), sizeof(T));
-        return sizeof(T);
+    static constexpr std::size_t size = sizeof(T);
+
+    bool parse(byte_span,byte_span field){
+        std::memcpy(static_cast<void*>(&data_), static_cast<const void*>(field.data()), sizeof(T));
+        return true;
     }
 
     data_type data(){
@@ -286,18 +806,12 @@ template<std::byte... bytes>
 struct fixed_data{
     using data_type = std::array<std::byte,sizeof...(bytes)>;
 
-    constexpr static std::array<std::byte,sizeof...(bytes)> bytes_data{bytes...};
+    static constexpr std::size_t size = sizeof...(bytes);
 
-    std::size_t parse(byte_span data){
-        if(data.size() < sizeof...(bytes)){
-            return 0;
-        }
-        
-        for(size_t i = 0; i < sizeof...(bytes); ++i)
-            if(data[i] != bytes_data[i])
-                return 0;
+    constexpr static std::array<std::byte,sizeof...(bytes)> bytes_data{bytes...};
 
-        return sizeof...(bytes);
+    bool parse(byte_span,byte_span field){
+        return std::equal(bytes_data.begin(), bytes_data.end(), field.begin());
     }
 
     data_type data(){
@@ -306,14 +820,67 @@ struct fixed_data{
 };
 
 /**
- * @brief 吃掉剩余全部数据的解析器。
+ * @brief 长度字段解析器，按本机字节序读取一个整数，作为后面变长字段的长度。
+ * @tparam T 长度字段的整数类型
+ */
+template<std::unsigned_integral T>
+struct length_data{
+    using data_type = T;
+
+    static constexpr std::size_t size = sizeof(T);
+
+    bool parse(byte_span,byte_span field){
+        std::memcpy(&data_, field.data(), sizeof(T));
+        return true;
+    }
+
+    data_type data(){
+        return data_;
+    }
+
+    std::size_t length() const{
+        return data_;
+    }
+
+    data_type data_;
+};
+
+/**
+ * @brief 校验字段解析器，校验从帧中第 Begin 个字节开始、到这个字段之前的全部数据。
+ * @tparam Algo 校验算法
+ * @tparam Begin 参与校验的第一个字节
+ */
+template<checksum Algo,std::size_t Begin = 0>
+struct checksum_data{
+    using data_type = typename Algo::value_type;
+
+    static constexpr std::size_t size = sizeof(data_type);
+
+    bool parse(byte_span frame,byte_span field){
+        std::memcpy(&data_, field.data(), sizeof(data_type));
+        return frame.size() >= Begin && Algo::compute(frame.subspan(Begin)) == data_;
+    }
+
+    data_type data(){
+        return data_;
+    }
+
+    data_type data_;
+};
+
+/**
+ * @brief 变长数据解析器。
+ * @details 长度由前面的长度字段决定，没有长度字段时吃掉剩余全部数据（尾部的定长字段除外）。
+ * 解析结果指向输入的字节，只在 feed() 的回调中有效。
  */
 struct other_all{
     using data_type = byte_span;
 
-    size_t parse(byte_span data){
-        data_ = data;
-        return data.size();
+    static constexpr std::size_t size = dynamic_size;
+
+    bool parse(byte_span,byte_span field){
+        data_ = field;
+        return true;
     }
 
     data_type data(){
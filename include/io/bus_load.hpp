@@ -0,0 +1,113 @@
+/**
+ * @file bus_load.hpp
+ * @brief CAN 总线负载估计。
+ * @details 根据波特率和每一帧的长度估计这一帧占用总线的时间，位填充按最坏情况计算，
+ * 再在一个滑动窗口内累加得到总线利用率。估计值偏保守，利用率接近 100% 之前就应该减少总线上的数据。
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace roboctrl::io{
+
+/**
+ * @brief 估计一帧 CAN 报文在最坏位填充下占用总线的时间。
+ * @details 经典帧按 (g + 8n + 13 + ⌊(g + 8n - 1) / 4⌋) 位计算，g 为标准帧 34、扩展帧 54，
+ * 13 位是 CRC 界定符、ACK、帧结束和帧间隔。CAN FD 帧把仲裁段和数据段分开计算，
+ * 开启 BRS 时数据段使用 data_bitrate。
+ * @param size 数据字节数
+ * @param extended 是否为扩展帧
+ * @param fd 是否为 CAN FD 帧
+ * @param brs CAN FD 帧是否切换到数据段波特率
+ * @param bitrate 仲裁段波特率
+ * @param data_bitrate 数据段波特率，为 0 时同 bitrate
+ */
+inline std::chrono::nanoseconds can_frame_time(std::size_t size,bool extended,bool fd,bool brs,
+    std::uint32_t bitrate,std::uint32_t data_bitrate = 0){
+    auto bits_time = [](std::uint64_t bits,std::uint32_t rate){
+        return std::chrono::nanoseconds{static_cast<std::int64_t>(bits * 1'000'000'000ull / rate)};
+    };
+
+    if(bitrate == 0)
+        return std::chrono::nanoseconds{0};
+
+    std::uint64_t data_bits = 8 * size;
+
+    if(!fd){
+        std::uint64_t stuffed = (extended ? 54 : 34) + data_bits;
+        return bits_time(stuffed + 13 + (stuffed - 1) / 4, bitrate);
+    }
+
+    // 仲裁段：帧起始、ID、RRS、IDE、FDF、res、BRS，之后回到仲裁段波特率的 CRC 界定符、ACK、帧结束和帧间隔
+    std::uint64_t arbitration = extended ? 36 : 17;
+    arbitration += (arbitration - 1) / 4 + 13;
+
+    // 数据段：ESI、DLC 和数据按最坏情况动态填充，填充计数和 CRC 每 4 位有一个固定填充位
+    std::uint64_t dynamic = 5 + data_bits;
+    std::uint64_t crc = size <= 16 ? 17 : 21;
+    std::uint64_t data = dynamic + (dynamic - 1) / 4 + 4 + crc + (crc + 4 + 3) / 4;
+
+    auto rate = brs && data_bitrate != 0 ? data_bitrate : bitrate;
+    return bits_time(arbitration, bitrate) + bits_time(data, rate);
+}
+
+/**
+ * @brief 滑动窗口内的总线利用率。
+ * @details 窗口被分成若干个桶，记录时只累加当前桶，时间前进时清空过期的桶，不需要保存每一帧。
+ * 和电控的其他部分一样只应在任务上下文所在的线程中使用。
+ */
+class bus_load{
+public:
+    static constexpr std::size_t bucket_count = 10;
+
+    /**
+     * @param window 窗口长度
+     */
+    explicit bus_load(std::chrono::nanoseconds window = std::chrono::milliseconds{100})
+        : bucket_width_{std::max(window / static_cast<std::int64_t>(bucket_count), std::chrono::nanoseconds{1})}
+    {}
+
+    /**
+     * @brief 记录一帧占用总线的时间。
+     * @param now 当前时间，见 utils::now()
+     */
+    inline void record(std::chrono::nanoseconds busy,std::chrono::nanoseconds now){
+        advance(now);
+        buckets_[current_ % bucket_count] += busy;
+    }
+
+    /**
+     * @brief 窗口内的总线利用率，1 表示总线被占满。
+     */
+    inline double utilization(std::chrono::nanoseconds now){
+        advance(now);
+
+        std::chrono::nanoseconds busy{0};
+        for(auto bucket : buckets_)
+            busy += bucket;
+
+        return static_cast<double>(busy.count()) / static_cast<double>(bucket_width_.count() * bucket_count);
+    }
+
+private:
+    inline void advance(std::chrono::nanoseconds now){
+        auto index = static_cast<std::uint64_t>(now / bucket_width_);
+        if(index <= current_)
+            return;
+
+        auto expired = std::min<std::uint64_t>(index - current_, bucket_count);
+        for(std::uint64_t i = 1; i <= expired; ++i)
+            buckets_[(current_ + i) % bucket_count] = std::chrono::nanoseconds{0};
+        current_ = index;
+    }
+
+    std::chrono::nanoseconds bucket_width_;
+    std::array<std::chrono::nanoseconds,bucket_count> buckets_{};
+    std::uint64_t current_ = 0;
+};
+
+}
@@ -5,29 +5,94 @@
  */
 #pragma once
 
+#include <array>
+#include <chrono>
 #include <cstdint>
+#include <memory>
 #include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <asio.hpp>
 #include <linux/can.h>
+#include <sys/socket.h>
 
 #include "base.hpp"
 #include "core/async.hpp"
 #include "core/logger.h"
+#include "io/bus_load.hpp"
+#include "io/rx_thread.hpp"
+#include "io/tx_queue.hpp"
 
 namespace roboctrl::io{
 
 using can_id_type = uint32_t;
 
+/**
+ * @brief CAN ID 的 key 表。
+ * @details 11 位标准帧 ID 直接作为下标查一个 2048 项的数组，一次索引即可找到槽位；
+ * 扩展帧 ID（带 CAN_EFF_FLAG）等其他 ID 退化为哈希表查找。
+ */
+class can_id_table{
+public:
+    inline key_slot* find(can_id_type id){
+        if(id <= CAN_SFF_MASK)
+            return standard_[id].get();
+
+        auto it = extended_.find(id);
+        return it == extended_.end() ? nullptr : &it->second;
+    }
+
+    inline key_slot& emplace(can_id_type id){
+        if(id <= CAN_SFF_MASK){
+            auto& slot = standard_[id];
+            if(!slot)
+                slot = std::make_unique<key_slot>();
+            return *slot;
+        }
+
+        return extended_[id];
+    }
+
+    template<typename Fn>
+    void for_each(Fn&& fn){
+        for(can_id_type id = 0; id < standard_.size(); ++id)
+            if(standard_[id])
+                fn(id,*standard_[id]);
+
+        for(auto& [id,slot] : extended_)
+            fn(id,slot);
+    }
+
+private:
+    std::array<std::unique_ptr<key_slot>,CAN_SFF_MASK + 1> standard_{};
+    std::unordered_map<can_id_type,key_slot> extended_;
+};
+
+static_assert(key_table<can_id_table,can_id_type>);
+
 /**
  * @brief CAN 设备对象，支持根据 ID 分发回调。
  */
-class can:public keyed_io_base<std::uint32_t>,public logable<can>{
+class can:public keyed_io_base<can_id_type,can_id_table>,public logable<can>{
 public:
     /**
      * @brief CAN 初始化参数。
      */
     struct info_type{
         std::string_view can_name;
+        tx_options tx{.policy = drop_policy::latest_wins};    ///< 发送队列参数，默认同一 ID 只保留最新的一帧
+        std::size_t rx_batch = 16;                              ///< 每次可读时最多用一次 recvmmsg() 读取的帧数
+        bool rx_timestamp = true;                               ///< 是否使用内核的接收时间戳（SO_TIMESTAMPING）作为 rx_time()
+        bool rx_filter = true;                                  ///< 是否只让内核收取注册了回调的 ID（CAN_RAW_FILTER）
+        bool error_frames = false;                              ///< 是否订阅错误帧（CAN_RAW_ERR_FILTER），错误帧以 error_frame_key 分发
+        bool fd = false;                                        ///< 是否开启 CAN FD（CAN_RAW_FD_FRAMES），开启后可以收发最多 64 字节的帧
+        bool brs = true;                                        ///< CAN FD 帧默认是否切换到数据段波特率（BRS）
+        bool bcm = false;                                       ///< 是否打开广播管理器（CAN_BCM）socket，用于 set_cyclic()
+        std::uint32_t bitrate = 1'000'000;                      ///< 仲裁段波特率，用于估计总线负载
+        std::uint32_t data_bitrate = 0;                         ///< CAN FD 数据段波特率，为 0 时同 bitrate
+        double shed_threshold = 0.8;                            ///< 总线负载超过这个值时丢弃 tx_priority::telemetry 的帧
+        rx_thread_options rx_thread{};                          ///< 是否在独立线程中接收，见 roboctrl::io::rx_thread
 
         using key_type = std::string_view;
         using owner_type = can;
@@ -35,39 +100,181 @@ public:
         std::string_view key() const{return can_name;}
     };
 
-    using key_type = std::uint32_t;
+    using key_type = can_id_type;
+
+    /**
+     * @brief 错误帧分发时使用的 key。
+     * @details 开启 info_type::error_frames 后，所有错误帧都以这个 key 分发，数据是完整的 can_frame，
+     * 其中 can_id 的低位是错误类别（见 linux/can/error.h）：
+     *
+     * ```cpp
+     * can.on_data(io::can::error_frame_key,[](const can_frame& frame){ ... });
+     * ```
+     */
+    static constexpr can_id_type error_frame_key = CAN_ERR_FLAG;
 
     /**
      * @brief 打开 CAN 设备。
      */
     can(const info_type& info);
 
-    ~can();
-
     /**
-     * @brief 发送裸帧。
+     * @brief 发送裸帧，data 必须是一个完整的 can_frame，FD 模式下也可以是 canfd_frame。
+     * @details 和带 ID 的 send() 一样只是放进发送队列。
      */
     awaitable<void> send(byte_span data);
 
     /**
      * @brief 发送带 CAN ID 的帧。
+     * @details 数据放进发送队列后立即返回，由写协程依次写出；队列满时按 info_type::tx 的策略丢弃。
+     * 不超过 8 字节的数据作为经典帧发送，FD 模式下超过 8 字节的数据作为 CAN FD 帧发送，并补零到合法的长度。
      */
     awaitable<void> send(can_id_type id,byte_span data);
 
+    /**
+     * @brief 以 CAN FD 帧发送数据，需要开启 info_type::fd。
+     * @param brs 这一帧是否切换到数据段波特率
+     */
+    awaitable<void> send_fd(can_id_type id,byte_span data,bool brs = true);
+
+    /**
+     * @brief 一次发送多帧。
+     * @details 所有帧一起放进发送队列，写协程会用一次 sendmmsg() 把它们写出去。
+     */
+    awaitable<void> send_batch(std::span<const std::pair<can_id_type,byte_span>> frames);
+
+    /**
+     * @brief 让内核以固定周期发送一帧，需要开启 info_type::bcm。
+     * @details 通过 CAN_BCM 的 TX_SETUP 实现，发送时机由内核定时器决定，不受事件循环调度延迟的影响。
+     * 对同一个 ID 再次调用时，如果周期没有变化，只会更新数据，内核从下一个周期开始发送新的数据。
+     * @return 是否设置成功
+     */
+    bool set_cyclic(can_id_type id,byte_span data,std::chrono::microseconds period);
+
+    /**
+     * @brief 停止 set_cyclic() 设置的周期发送。
+     * @return 是否成功
+     */
+    bool stop_cyclic(can_id_type id);
+
+    /**
+     * @brief 是否开启了 CAN_BCM。
+     */
+    inline bool bcm_enabled() const { return info_.bcm; }
+
+    /**
+     * @brief 设置一个 ID 的发送优先级，默认为 tx_priority::normal。
+     * @details 写协程每次按优先级从高到低发送积压的帧；总线负载超过 info_type::shed_threshold 时，
+     * tx_priority::telemetry 的帧在 send() 时直接丢弃，计入 tx dropped。
+     */
+    inline void set_priority(can_id_type id,tx_priority priority){ priorities_[id] = priority; }
+
+    /**
+     * @brief 获取一个 ID 的发送优先级。
+     */
+    inline tx_priority priority(can_id_type id) const{
+        auto it = priorities_.find(id);
+        return it == priorities_.end() ? tx_priority::normal : it->second;
+    }
+
+    /**
+     * @brief 估计的总线负载，1 表示总线被占满。
+     * @details 根据 info_type::bitrate 计算最近 100ms 内收发的帧和 set_cyclic() 的周期帧占用总线的时间，位填充按最坏情况计算。
+     * 开启 rx_filter 时，内核丢弃的其他 ID 的帧不会计入，这时的估计值偏低。
+     * 周期帧经回环再被这个 socket 收到时不重复计入。
+     */
+    double load();
+
     /**
      * @brief 接收循环任务。
+     * @details 每次 socket 可读时用一次 recvmmsg() 读出最多 info_type::rx_batch 帧，逐帧分发。
+     * 开启 rx_timestamp 时，回调中 rx_time() 返回内核收到这一帧的时间（软件时间戳）。
+     * 开启 info_type::rx_thread 时不启动这个任务，改为在独立线程中读取，回调仍在任务上下文中执行。
      */
     awaitable<void> task();
 
     std::string desc()const{
-        return std::format("bare can({})",info_.can_name);
+        return std::format("bare can({}{})",info_.can_name,info_.fd ? ", fd" : "");
     }
 
 private:
+    /**
+     * @brief 独立接收线程交给任务上下文的一帧。
+     */
+    struct rx_frame{
+        ::canfd_frame frame;
+        std::size_t mtu;
+        std::chrono::nanoseconds time;
+        bool local;
+    };
+
+    /**
+     * @brief 用一次 recvmmsg() 读取最多 rx_batch 帧，并算出每一帧的接收时间。
+     * @return 读到的帧数
+     */
+    int receive();
+
+    /**
+     * @brief 分发一帧，mtu 是 recvmmsg() 读到的字节数。
+     * @param local 是否是本机发出、经回环收到的帧（MSG_DONTROUTE）
+     */
+    void handle(const ::canfd_frame& cf,std::size_t mtu,std::chrono::nanoseconds rx_time,bool local);
+
+    /**
+     * @brief 检查数据长度并生成发送队列中的帧标志。
+     * @param fd 是否强制作为 CAN FD 帧发送
+     */
+    std::uint8_t frame_flags(std::size_t size,bool fd,bool brs) const;
+
+    awaitable<void> write(std::span<tx_queue<can_id_type>::entry> batch);
+
+    /**
+     * @brief 根据注册了回调的 ID 重新生成内核过滤器。
+     */
+    void install_filters();
+
+    /**
+     * @brief 把一帧的总线占用时间计入负载。
+     */
+    void record_load(can_id_type id,std::size_t size,bool fd,bool brs);
+
+    /**
+     * @brief 检查优先级和总线负载后放进发送队列。
+     */
+    void enqueue(can_id_type id,byte_span data,std::uint8_t flags);
+
+    /**
+     * @brief 根据当前负载更新 overloaded_，越过阈值时输出一次日志。
+     * @return 更新后的 overloaded_
+     */
+    bool update_overload();
+
+    struct cyclic_frame{
+        std::chrono::microseconds period;
+        std::chrono::nanoseconds frame_time;
+    };
+
     asio::posix::stream_descriptor stream_;
+    asio::posix::stream_descriptor bcm_;
+    std::unordered_map<can_id_type,cyclic_frame> cyclic_;
+    std::unordered_map<can_id_type,tx_priority> priorities_;
+    bus_load load_;
+    bool overloaded_ = false;
     info_type info_;
-    std::array<std::byte,20> buffer_;
-    ::can_frame *cf_;
+    std::vector<::canfd_frame> rx_frames_;
+    std::vector<::iovec> rx_iovs_;
+    std::vector<::mmsghdr> rx_msgs_;
+    std::vector<std::chrono::nanoseconds> rx_times_;
+    bool filters_dirty_ = false;
+    std::vector<std::byte> rx_control_;
     std::string can_name_;
+    tx_queue<can_id_type> tx_;
+    std::vector<::canfd_frame> tx_frames_;
+    std::vector<::iovec> tx_iovs_;
+    std::vector<::mmsghdr> tx_msgs_;
+    // 最后构造、最先析构，保证接收线程退出前它用到的成员都还有效
+    rx_thread<rx_frame,256> rx_thread_;
 };
+
+static_assert(keyed_io<can>);
 }
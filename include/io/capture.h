@@ -0,0 +1,164 @@
+/**
+ * @file capture.h
+ * @brief IO 数据的录制与回放。
+ * @details capture 把所有 IO 收到的每一帧写入一个内存映射的二进制文件，replay 再把文件中的数据按原来的节奏
+ * （或者尽可能快地）送回相同的分发路径。这样可以在没有 CAN 硬件的电脑上，用真实的比赛数据测试控制逻辑的修改。
+ *
+ * 文件由一个 capture_file_header 和若干条记录组成，每条记录是一个 capture_record_header，后面依次紧跟
+ * IO 名称、key 的字节和数据本身，全部使用本机字节序，没有对齐填充。
+ */
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "core/async.hpp"
+#include "core/logger.h"
+#include "utils/singleton.hpp"
+
+namespace roboctrl::io{
+
+/**
+ * @brief 录制数据所属的 IO 类型。
+ */
+enum class io_kind : std::uint8_t{
+    can = 0,
+    serial = 1,
+    udp = 2,
+    tcp = 3,
+    shm = 4
+};
+
+/**
+ * @brief 录制文件头。
+ */
+struct capture_file_header{
+    static constexpr std::uint64_t magic_value = 0x3150414343524b47; // "GKRCCAP1"
+
+    std::uint64_t magic;
+    std::uint64_t size;     ///< 文件中有效数据（含文件头）的字节数
+} __attribute__((packed));
+
+/**
+ * @brief 一条录制记录的头。
+ */
+struct capture_record_header{
+    std::uint64_t timestamp;    ///< 收到数据的时间，即分发时的 rx_time()，程序启动后的纳秒数
+    io_kind kind;               ///< IO 类型
+    std::uint8_t name_size;     ///< IO 名称的长度
+    std::uint8_t key_size;      ///< key 的字节数，裸 IO 为 0
+    std::uint8_t reserved;
+    std::uint32_t data_size;    ///< 数据的字节数
+} __attribute__((packed));
+
+/**
+ * @brief IO 录制器。
+ * @details 初始化时会给当时已经存在的全部 can、serial、udp、tcp、shm 多例对象装上抓包回调，因此应该在 IO 初始化之后再初始化录制器。
+ * 文件会按需扩容，程序退出时截断到实际大小。示例：
+ *
+ * ```cpp
+ * roboctrl::init(roboctrl::io::capture::info_type{.path = "match.cap"});
+ * ```
+ */
+class capture : public utils::singleton_base<capture>,public logable<capture>{
+public:
+    struct info_type{
+        using owner_type = capture;
+
+        std::string path;                       ///< 录制文件路径
+        std::size_t capacity = 64 << 20;        ///< 初始文件大小，写满后自动翻倍
+    };
+
+    ~capture();
+
+    bool init(const info_type& info);
+
+    inline std::string desc()const{
+        return std::format("capture to {}",info_.path);
+    }
+
+    /**
+     * @brief 写入一条记录。
+     * @param timestamp 数据的接收时间，即 IO 分发这一帧时的 rx_time()
+     */
+    void record(io_kind kind,std::string_view name,std::span<const std::byte> key,std::span<const std::byte> data,std::chrono::nanoseconds timestamp);
+
+    /**
+     * @brief 已经录制的记录数。
+     */
+    inline std::uint64_t records()const{return records_;}
+
+private:
+    template<typename T>
+    void attach(io_kind kind);
+
+    bool reserve(std::size_t size);
+
+    info_type info_;
+    int fd_ = -1;
+    std::byte* map_ = nullptr;
+    std::size_t capacity_ = 0;
+    std::size_t size_ = 0;
+    std::uint64_t records_ = 0;
+};
+
+static_assert(utils::singleton<capture>);
+
+/**
+ * @brief IO 回放器。
+ * @details 读取 capture 录制的文件，按 IO 名称找到对应的多例对象，并通过它的 dispatch() 把数据送回去，
+ * 所有的回调、统计都和真实收到数据时一样。回放前需要先初始化好对应的 IO，没有 CAN 硬件时可以使用虚拟 CAN：
+ *
+ * ```shell
+ * sudo ip link add dev CAN_CHASSIS type vcan && sudo ip link set up CAN_CHASSIS
+ * ```
+ *
+ * 找不到对应 IO 的记录会被跳过。回放时每一帧的 rx_time() 是把录制的时间戳平移到回放开始时刻得到的，
+ * 帧与帧之间的时间间隔和录制时一致。
+ */
+class replay : public utils::singleton_base<replay>,public logable<replay>{
+public:
+    struct info_type{
+        using owner_type = replay;
+
+        std::string path;           ///< 录制文件路径
+        bool realtime = true;       ///< true 按录制时的节奏回放，false 尽可能快地回放
+        bool loop = false;          ///< 回放结束后是否从头开始
+    };
+
+    ~replay();
+
+    bool init(const info_type& info);
+
+    inline std::string desc()const{
+        return std::format("replay from {}",info_.path);
+    }
+
+    awaitable<void> task();
+
+    /**
+     * @brief 已经回放的记录数。
+     */
+    inline std::uint64_t records()const{return records_;}
+
+private:
+    void dispatch(const capture_record_header& header,std::string_view name,std::span<std::byte> key,std::span<std::byte> data,std::chrono::nanoseconds rx_time);
+
+    template<typename T>
+    static bool dispatch_to(std::string_view name,std::span<std::byte> key,std::span<std::byte> data,std::chrono::nanoseconds rx_time);
+
+    info_type info_;
+    std::byte* map_ = nullptr;
+    std::size_t size_ = 0;
+    std::uint64_t records_ = 0;
+    std::uint64_t skipped_ = 0;
+};
+
+static_assert(utils::singleton<replay>);
+
+}
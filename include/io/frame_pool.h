@@ -0,0 +1,170 @@
+/**
+ * @file frame_pool.h
+ * @brief 池化的帧缓冲。
+ * @details IO 每收到一帧都要把数据拷贝到一个缓冲中再交给回调。为了避免每一帧都在堆上分配，
+ * frame_pool 按固定大小的块维护空闲链表，frame_buffer 的最后一个引用释放时，块会回到池中。
+ * 稳态下分发数据不会再产生任何分配。
+ */
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <span>
+#include <string>
+#include <utility>
+
+#include "utils/concepts.hpp"
+
+namespace roboctrl::io{
+
+class frame_pool;
+
+/// @cond INTERNAL
+namespace details{
+
+struct frame_block{
+    frame_block* next;          // 空闲链表
+    frame_pool* pool;           // 申请这个块的池，释放时归还给它
+    std::uint32_t refs;
+    std::uint32_t size;
+    std::uint32_t capacity;
+    std::uint32_t size_class;   // 等于 frame_pool::block_sizes.size() 时表示超出池大小，直接在堆上分配
+
+    inline std::byte* data(){ return reinterpret_cast<std::byte*>(this + 1); }
+};
+
+}
+/// @endcond
+
+/**
+ * @brief 带引用计数的帧缓冲。
+ * @details 语义上和 std::shared_ptr<std::vector<std::byte>> 一致：拷贝只增加引用计数，不拷贝数据。
+ * 内存来自 frame_pool，最后一个引用释放时归还给申请它的池，而不是当前线程的池。
+ * 引用计数和池的空闲链表都不是原子的，帧缓冲只能在申请它的线程中拷贝和释放，调试构建中会检查这一点；
+ * 需要跨线程传递数据时应拷贝数据本身，例如 rx_thread 的做法。
+ */
+class frame_buffer{
+public:
+    frame_buffer() = default;
+
+    inline frame_buffer(const frame_buffer& other) noexcept : block_{other.block_} {
+        if(block_)
+            ++block_->refs;
+    }
+
+    inline frame_buffer(frame_buffer&& other) noexcept : block_{std::exchange(other.block_, nullptr)} {}
+
+    inline frame_buffer& operator=(frame_buffer other) noexcept {
+        std::swap(block_, other.block_);
+        return *this;
+    }
+
+    inline ~frame_buffer(){ reset(); }
+
+    /**
+     * @brief 释放当前引用。
+     */
+    void reset() noexcept;
+
+    inline std::byte* data() const { return block_ ? block_->data() : nullptr; }
+    inline std::size_t size() const { return block_ ? block_->size : 0; }
+    inline bool empty() const { return size() == 0; }
+
+    /**
+     * @brief 以 span 的形式访问缓冲内容。
+     */
+    inline std::span<std::byte> span() const { return {data(), size()}; }
+
+    inline explicit operator bool() const { return block_ != nullptr; }
+
+    /**
+     * @brief 当前块的引用计数。
+     */
+    inline std::size_t use_count() const { return block_ ? block_->refs : 0; }
+
+private:
+    friend frame_pool;
+    inline explicit frame_buffer(details::frame_block* block) noexcept : block_{block} {}
+
+    details::frame_block* block_ = nullptr;
+};
+
+/**
+ * @brief 帧缓冲池。
+ * @details 按 block_sizes 分成几档固定大小的块，每档维护一条空闲链表。申请时选择能装下数据的最小一档，
+ * 空闲链表为空时才向系统申请新块；超过最大一档的数据直接在堆上分配，释放时归还给系统。
+ *
+ * 每个线程有一个自己的池，可以通过 frame_pool::local() 获取。通过 stats() 可以看到池的命中情况：
+ *
+ * ```cpp
+ * auto& s = roboctrl::io::frame_pool::local().stats();
+ * log_info("frame pool hit rate: {:.2f}%", s.hit_rate() * 100);
+ * ```
+ */
+class frame_pool :
+    public utils::immovable_base,
+    public utils::not_copyable_base{
+public:
+    /// @brief 各档块的容量（字节）
+    static constexpr std::array<std::size_t,3> block_sizes{64, 256, 2048};
+
+    /**
+     * @brief 池的统计信息。
+     */
+    struct stats_type{
+        std::uint64_t hits = 0;         ///< 从空闲链表直接取到块的次数
+        std::uint64_t misses = 0;       ///< 需要向系统申请内存的次数（含超大帧）
+        std::uint64_t oversize = 0;     ///< 超出最大一档、直接在堆上分配的次数
+        std::uint64_t blocks = 0;       ///< 池中持有的块总数
+        std::uint64_t in_use = 0;       ///< 正在被使用的块数
+
+        /**
+         * @brief 命中率，范围 [0,1]。
+         */
+        inline double hit_rate() const{
+            auto total = hits + misses;
+            return total == 0 ? 1.0 : static_cast<double>(hits) / static_cast<double>(total);
+        }
+    };
+
+    frame_pool() = default;
+    ~frame_pool();
+
+    /**
+     * @brief 获取当前线程的帧缓冲池。
+     */
+    static frame_pool& local();
+
+    /**
+     * @brief 申请一个能容纳 size 字节的帧缓冲，内容未初始化。
+     */
+    frame_buffer acquire(std::size_t size);
+
+    inline const stats_type& stats() const { return stats_; }
+
+    inline std::string desc() const{
+        return std::format("frame pool (hit rate {:.2f}%, {} blocks, {} in use, {} oversize)",
+            stats_.hit_rate() * 100, stats_.blocks, stats_.in_use, stats_.oversize);
+    }
+
+private:
+    friend frame_buffer;
+    void release(details::frame_block* block) noexcept;
+
+    std::array<details::frame_block*, block_sizes.size()> free_{};
+    stats_type stats_;
+};
+
+inline void frame_buffer::reset() noexcept {
+    if(block_){
+        assert(block_->pool == &frame_pool::local() && "frame_buffer released on a thread other than its pool's");
+        if(--block_->refs == 0)
+            block_->pool->release(block_);
+    }
+    block_ = nullptr;
+}
+
+}
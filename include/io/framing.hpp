@@ -0,0 +1,201 @@
+/**
+ * @file framing.hpp
+ * @brief 字节流的分帧。
+ * @details TCP 这类字节流没有消息边界：一次读取可能只读到半条消息，也可能读到好几条。这里提供长度前缀分帧，
+ * 以及一个可增长的接收缓冲：数据直接读进缓冲，拆出的每一帧都是缓冲中的一段 span，分发前不需要再拷贝。
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace roboctrl::io{
+
+/**
+ * @brief 字节流的分帧方式。
+ */
+enum class stream_framing : std::uint8_t{
+    none,       ///< 不分帧，每次读到的数据原样分发
+    u32,        ///< 每帧前面是 4 字节小端的长度
+    varint      ///< 每帧前面是 LEB128 变长编码的长度（与 protobuf 的 delimited 格式相同）
+};
+
+/**
+ * @brief 长度前缀的最大字节数。
+ */
+constexpr std::size_t max_length_prefix = 10;
+
+/**
+ * @brief 编码长度前缀。
+ * @return 前缀的字节数，stream_framing::none 时为 0
+ */
+inline std::size_t encode_length_prefix(stream_framing framing,std::size_t size,std::array<std::byte,max_length_prefix>& out){
+    switch(framing){
+    case stream_framing::u32:{
+        if(size > UINT32_MAX)
+            throw std::length_error(std::format("frame of {} bytes is too long for u32 framing", size));
+        auto length = static_cast<std::uint32_t>(size);
+        std::memcpy(out.data(), &length, sizeof(length));
+        return sizeof(length);
+    }
+    case stream_framing::varint:{
+        std::size_t n = 0;
+        do{
+            auto byte = static_cast<std::uint8_t>(size & 0x7f);
+            size >>= 7;
+            out[n++] = static_cast<std::byte>(size ? byte | 0x80 : byte);
+        }while(size);
+        return n;
+    }
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief 给几段数据加上长度前缀。
+ * @details 前缀作为第一段，连同原来的几段一起交给 fn，调用者可以把它们拼进同一个帧缓冲。
+ * stream_framing::none 时原样交给 fn。开启分帧时最多 7 段，更多时抛出 std::invalid_argument。
+ * @param fn 接受 `std::span<const std::span<std::byte>>` 的函数
+ * @return fn 的返回值
+ */
+template<typename Fn>
+decltype(auto) with_length_prefix(stream_framing framing,std::span<const std::span<std::byte>> parts,Fn&& fn){
+    if(framing == stream_framing::none)
+        return fn(parts);
+
+    std::size_t size = 0;
+    for(auto part : parts)
+        size += part.size();
+
+    std::array<std::byte,max_length_prefix> prefix;
+    auto prefix_size = encode_length_prefix(framing, size, prefix);
+
+    std::array<std::span<std::byte>,8> buffers;
+    if(parts.size() + 1 > buffers.size())
+        throw std::invalid_argument(std::format("can't send more than {} parts in one frame", buffers.size() - 1));
+
+    buffers[0] = std::span<std::byte>{prefix.data(), prefix_size};
+    std::copy(parts.begin(), parts.end(), buffers.begin() + 1);
+    return fn(std::span<const std::span<std::byte>>{buffers.data(), parts.size() + 1});
+}
+
+/**
+ * @brief 从数据中拆出全部完整的帧。
+ * @param emit 对每一帧的数据（不含前缀）以 byte_span 调用，span 指向 data 内部
+ * @param max_frame 允许的最大帧长，超过时抛出 std::length_error，这时流已经无法再同步，应当断开连接
+ * @return 已经处理掉的字节数，剩下的是不完整的帧
+ */
+template<typename Emit>
+std::size_t decode_frames(stream_framing framing,std::span<std::byte> data,std::size_t max_frame,Emit&& emit){
+    if(framing == stream_framing::none){
+        if(!data.empty())
+            emit(data);
+        return data.size();
+    }
+
+    std::size_t pos = 0;
+    while(pos < data.size()){
+        std::size_t size = 0;
+        std::size_t prefix = 0;
+
+        if(framing == stream_framing::u32){
+            if(data.size() - pos < sizeof(std::uint32_t))
+                break;
+            std::uint32_t length;
+            std::memcpy(&length, data.data() + pos, sizeof(length));
+            size = length;
+            prefix = sizeof(length);
+        }
+        else{
+            bool complete = false;
+            for(int shift = 0; pos + prefix < data.size(); shift += 7){
+                if(prefix == max_length_prefix)
+                    throw std::length_error("malformed varint frame length");
+                auto byte = std::to_integer<std::uint8_t>(data[pos + prefix++]);
+                size |= static_cast<std::size_t>(byte & 0x7f) << shift;
+                if(!(byte & 0x80)){
+                    complete = true;
+                    break;
+                }
+            }
+            if(!complete)
+                break;
+        }
+
+        if(size > max_frame)
+            throw std::length_error(std::format("frame of {} bytes exceeds limit of {} bytes", size, max_frame));
+
+        if(data.size() - pos - prefix < size)
+            break;
+
+        emit(data.subspan(pos + prefix, size));
+        pos += prefix + size;
+    }
+
+    return pos;
+}
+
+/**
+ * @brief 可增长的接收缓冲。
+ * @details 读取时用 prepare() 取得空闲空间直接读进去，commit() 之后 data() 就是所有未处理的数据，
+ * 处理完的部分用 consume() 丢掉。空闲空间不够时先把未处理的数据移到开头，仍然不够才扩容，
+ * 容量只增不减，稳态下不会分配内存。
+ */
+class stream_buffer{
+public:
+    explicit stream_buffer(std::size_t capacity = 4096)
+        : buffer_(capacity)
+    {}
+
+    /**
+     * @brief 获取至少 size 字节的空闲空间。
+     */
+    inline std::span<std::byte> prepare(std::size_t size){
+        if(buffer_.size() - end_ < size){
+            if(begin_ > 0){
+                std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+                end_ -= begin_;
+                begin_ = 0;
+            }
+            if(buffer_.size() - end_ < size)
+                buffer_.resize(std::max(buffer_.size() * 2, end_ + size));
+        }
+        return std::span{buffer_}.subspan(end_);
+    }
+
+    /**
+     * @brief 把读进空闲空间的 size 字节计入数据。
+     */
+    inline void commit(std::size_t size){ end_ += size; }
+
+    /**
+     * @brief 所有未处理的数据。
+     */
+    inline std::span<std::byte> data(){ return std::span{buffer_}.subspan(begin_, end_ - begin_); }
+
+    /**
+     * @brief 丢掉开头 size 字节已经处理的数据。
+     */
+    inline void consume(std::size_t size){
+        begin_ += size;
+        if(begin_ == end_)
+            begin_ = end_ = 0;
+    }
+
+    inline std::size_t capacity() const { return buffer_.size(); }
+
+private:
+    std::vector<std::byte> buffer_;
+    std::size_t begin_ = 0;
+    std::size_t end_ = 0;
+};
+
+}
@@ -0,0 +1,313 @@
+/**
+ * @file loopback.hpp
+ * @brief 进程内的回环 IO。
+ * @details 不依赖任何设备，两个端点通过无锁环形队列互相连接：一端 send() 的数据会被另一端的回调收到。
+ * 可以用来在普通的 Linux 电脑上测试设备和控制逻辑，或者对整套代码做可复现的吞吐测试。
+ */
+#pragma once
+
+#include <array>
+#include <asio.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "core/async.hpp"
+#include "core/logger.h"
+#include "core/multiton.hpp"
+#include "io/base.hpp"
+#include "utils/spsc_ring.hpp"
+
+namespace roboctrl::io{
+
+/**
+ * @brief 回环 IO 一帧数据的最大字节数。
+ */
+constexpr std::size_t loopback_frame_size = 256;
+
+/**
+ * @brief 回环 IO 每个端点接收队列的深度。
+ */
+constexpr std::size_t loopback_depth = 128;
+
+/// @cond INTERNAL
+namespace details{
+
+template<typename TK>
+struct loopback_frame{
+    TK key{};
+    std::size_t size = 0;
+    std::array<std::byte,loopback_frame_size> data{};
+};
+
+/**
+ * 端点的接收通道。push() 可以在任务上下文之外的线程中调用，但同一时刻只能有一个生产者线程，
+ * 因为底层的 spsc_ring 不支持多个发送方并发写入；drain() 在任务上下文中运行。
+ * 接收任务没有数据可读时挂起在一个永不到期的定时器上，发送方通过 post 一个 cancel 唤醒它，
+ * waiting_ 保证每次挂起最多只 post 一次。
+ */
+template<typename TK>
+class loopback_channel{
+public:
+    loopback_channel()
+        : timer_{roboctrl::executor(), asio::steady_timer::time_point::max()}
+    {}
+
+    inline bool push(const TK& key,std::span<const byte_span> parts){
+        std::size_t size = 0;
+        for(auto part : parts)
+            size += part.size();
+
+        auto slot = ring_.prepare();
+        if(!slot)
+            return false;
+
+        slot->key = key;
+        slot->size = size;
+        auto out = slot->data.data();
+        for(auto part : parts){
+            std::memcpy(out, part.data(), part.size());
+            out += part.size();
+        }
+        ring_.commit();
+
+        // 与 drain() 中的栅栏配对：发送方先提交帧再检查 waiting_，接收方先置位 waiting_ 再检查队列，
+        // 两边都加上 seq_cst 栅栏，保证不会出现帧已经入队、接收任务却一直挂起的情况。
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(waiting_.exchange(false, std::memory_order_acq_rel))
+            asio::post(timer_.get_executor(), [this]{ timer_.cancel(); });
+
+        return true;
+    }
+
+    template<typename Fn>
+    awaitable<void> drain(Fn fn){
+        while(true){
+            while(auto frame = ring_.front()){
+                fn(frame->key, byte_span{frame->data.data(), frame->size});
+                ring_.pop();
+            }
+
+            waiting_.store(true, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(!ring_.empty()){
+                waiting_.store(false, std::memory_order_release);
+                continue;
+            }
+
+            asio::error_code ec;
+            timer_.expires_at(asio::steady_timer::time_point::max());
+            co_await timer_.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+        }
+    }
+
+private:
+    utils::spsc_ring<loopback_frame<TK>,loopback_depth> ring_;
+    asio::steady_timer timer_;
+    std::atomic<bool> waiting_{false};
+};
+
+/**
+ * 把数据放进对端的接收通道，对端队列满时让出执行权等待对端消费。
+ */
+template<typename TK>
+awaitable<void> loopback_send(loopback_channel<TK>& peer,const TK& key,std::span<const byte_span> parts){
+    std::size_t size = 0;
+    for(auto part : parts)
+        size += part.size();
+
+    if(size > loopback_frame_size)
+        throw std::length_error(std::format("loopback frame of {} bytes exceeds {} bytes",size,loopback_frame_size));
+
+    while(!peer.push(key, parts))
+        co_await roboctrl::yield();
+}
+
+}
+/// @endcond
+
+/**
+ * @brief 回环裸 IO。
+ * @details 每个端点通过 peer 指定对端的名称，peer 为空时发给自己。两个端点互为对端即组成一条双向链路，
+ * 和其他 IO 一样可以写在 config 的列表中：
+ *
+ * ```cpp
+ * constexpr std::initializer_list<io::loopback_bare::info_type> loopbacks = {
+ *     {"referee","referee_sim"},
+ *     {"referee_sim","referee"}
+ * };
+ * ```
+ *
+ * 对端在第一次 send() 时才查找，因此两个端点的初始化顺序没有要求。一帧最多 loopback_frame_size 个字节。
+ */
+class loopback_bare : public bare_io_base,public logable<loopback_bare>{
+public:
+    /**
+     * @brief 回环裸 IO 初始化参数。
+     */
+    struct info_type{
+        using key_type = std::string_view;
+        using owner_type = loopback_bare;
+
+        std::string_view name;      ///< 端点名称
+        std::string_view peer;      ///< 对端名称，为空时发给自己
+
+        std::string_view key()const{
+            return name;
+        }
+    };
+
+    explicit loopback_bare(const info_type& info)
+        : bare_io_base{},info_{info}
+    {
+        roboctrl::spawn(task());
+    }
+
+    /**
+     * @brief 向对端发送一段字节数据。
+     */
+    awaitable<void> send(byte_span data){
+        co_await send(std::span<const byte_span>{&data, 1});
+    }
+
+    /**
+     * @brief 把分散的几段数据作为一帧发送给对端。
+     */
+    awaitable<void> send(std::span<const byte_span> parts){
+        try{
+            co_await details::loopback_send(peer().channel_, std::monostate{}, parts);
+        }
+        catch(...){
+            record_send_error();
+            throw;
+        }
+
+        std::size_t size = 0;
+        for(auto part : parts)
+            size += part.size();
+        record_tx(size);
+    }
+
+    /**
+     * @brief 接收循环任务。
+     */
+    awaitable<void> task(){
+        co_await channel_.drain([this](std::monostate,byte_span data){
+            dispatch(data);
+        });
+    }
+
+    inline std::string desc()const{
+        return std::format("loopback ({} to {})",info_.name,info_.peer.empty() ? info_.name : info_.peer);
+    }
+
+private:
+    inline loopback_bare& peer(){
+        return info_.peer.empty() ? *this : roboctrl::get<loopback_bare>(info_.peer);
+    }
+
+    info_type info_;
+    details::loopback_channel<std::monostate> channel_;
+};
+
+static_assert(bare_io<loopback_bare>);
+
+/**
+ * @brief 回环带键值 IO。
+ * @details 和 loopback_bare 一样通过 peer 连接对端，但每一帧都带一个 key，对端按 key 分发给对应的回调，
+ * 可以用来代替 can 测试马达等设备：
+ *
+ * ```cpp
+ * using can_loopback = roboctrl::io::loopback_keyed<roboctrl::io::can_id_type>;
+ *
+ * constexpr std::initializer_list<can_loopback::info_type> can_loopbacks = {
+ *     {"can0","motor_sim"},
+ *     {"motor_sim","can0"}
+ * };
+ * ```
+ *
+ * @tparam TK key 类型，必须可以平凡拷贝
+ */
+template<typename TK>
+class loopback_keyed : public keyed_io_base<TK>,public logable<loopback_keyed<TK>>{
+    static_assert(std::is_trivially_copyable_v<TK>, "key of loopback_keyed must be trivially copyable");
+
+public:
+    /**
+     * @brief 回环带键值 IO 初始化参数。
+     */
+    struct info_type{
+        using key_type = std::string_view;
+        using owner_type = loopback_keyed;
+
+        std::string_view name;      ///< 端点名称
+        std::string_view peer;      ///< 对端名称，为空时发给自己
+
+        std::string_view key()const{
+            return name;
+        }
+    };
+
+    using key_type = TK;
+
+    explicit loopback_keyed(const info_type& info)
+        : keyed_io_base<TK>{},info_{info}
+    {
+        roboctrl::spawn(task());
+    }
+
+    /**
+     * @brief 向对端发送带 key 的数据。
+     */
+    awaitable<void> send(TK key,byte_span data){
+        try{
+            co_await details::loopback_send(peer().channel_, key, std::span<const byte_span>{&data, 1});
+        }
+        catch(...){
+            this->record_send_error();
+            throw;
+        }
+
+        this->record_tx(key, data.size());
+    }
+
+    /**
+     * @brief 一次向对端发送多帧。
+     */
+    awaitable<void> send_batch(std::span<const std::pair<TK,byte_span>> frames){
+        for(auto& [key, data] : frames)
+            co_await send(key, data);
+    }
+
+    /**
+     * @brief 接收循环任务。
+     */
+    awaitable<void> task(){
+        co_await channel_.drain([this](const TK& key,byte_span data){
+            this->dispatch(key, data);
+        });
+    }
+
+    inline std::string desc()const{
+        return std::format("keyed loopback ({} to {})",info_.name,info_.peer.empty() ? info_.name : info_.peer);
+    }
+
+private:
+    inline loopback_keyed& peer(){
+        return info_.peer.empty() ? *this : roboctrl::get<loopback_keyed>(info_.peer);
+    }
+
+    info_type info_;
+    details::loopback_channel<TK> channel_;
+};
+
+static_assert(keyed_io<loopback_keyed<std::uint32_t>>);
+
+}
@@ -0,0 +1,183 @@
+/**
+ * @file rx_thread.hpp
+ * @brief IO 的独立接收线程。
+ * @details 默认情况下所有 IO 都在任务上下文的唯一线程中接收数据，一次慢的串口解析或者一阵日志输出都会推迟 CAN 反馈的处理。
+ * 开启独立接收线程后，IO 在自己的（可以绑定 CPU 核的）线程中读取并解码数据，把解码好的帧放进无锁的单生产者单消费者队列，
+ * 再由任务上下文取出并分发给回调。回调仍然只在任务上下文中执行，控制代码的单线程编程模型保持不变。
+ */
+#pragma once
+
+#include <array>
+#include <asio.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+#include "core/async.hpp"
+#include "utils/concepts.hpp"
+#include "utils/spsc_ring.hpp"
+
+namespace roboctrl::io{
+
+/**
+ * @brief 独立接收线程参数，作为 can、serial 的 info_type 中的 rx_thread 字段。
+ */
+struct rx_thread_options{
+    bool enabled = false;   ///< 是否在独立线程中接收，默认在任务上下文中接收
+    int cpu = -1;           ///< 接收线程绑定的 CPU 核，-1 表示不绑定
+};
+
+/**
+ * @brief 独立接收线程。
+ * @details 接收线程等待文件描述符可读，然后调用 IO 提供的读取函数。读取函数通过 prepare()/commit() 把解码好的帧写进队列，
+ * 读取函数返回后，如果任务上下文中还没有待执行的取出任务，就 post 一个。队列满时新的帧被丢弃，计入 overruns()。
+ *
+ * ```cpp
+ * rx_.start(name, options, fd,
+ *     [this](auto& rx){             // 在接收线程中
+ *         if(auto slot = rx.prepare()){
+ *             slot->size = ::read(fd, slot->data.data(), slot->data.size());
+ *             rx.commit();
+ *         }
+ *     },
+ *     [this](frame& f){ ... });     // 在任务上下文中
+ * ```
+ *
+ * @tparam Frame 队列中的帧类型，需要可默认构造
+ * @tparam Capacity 队列容量，必须是 2 的幂
+ */
+template<typename Frame,std::size_t Capacity>
+class rx_thread : public utils::immovable_base, public utils::not_copyable_base{
+public:
+    rx_thread()
+        : executor_{roboctrl::executor()}
+    {}
+
+    ~rx_thread(){
+        stop();
+    }
+
+    /**
+     * @brief 启动接收线程。
+     * @param name 线程名，超过 15 个字符的部分会被截掉
+     * @param read 在接收线程中、fd 可读时调用，参数是这个 rx_thread 本身
+     * @param handle 在任务上下文中对每一帧调用
+     */
+    template<typename Read>
+    void start(std::string_view name,const rx_thread_options& options,int fd,Read read,std::function<void(Frame&)> handle){
+        wake_ = ::eventfd(0, EFD_CLOEXEC);
+        if(wake_ < 0)
+            throw std::runtime_error("eventfd() failed");
+
+        handle_ = std::move(handle);
+        thread_ = std::thread([this, name = std::string{name.substr(0, 15)}, cpu = options.cpu, fd, read = std::move(read)]() mutable {
+            ::pthread_setname_np(::pthread_self(), name.c_str());
+
+            if(cpu >= 0){
+                ::cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpu, &set);
+                ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+            }
+
+            std::array<::pollfd,2> fds{{{fd, POLLIN, 0}, {wake_, POLLIN, 0}}};
+            while(true){
+                if(::poll(fds.data(), fds.size(), -1) < 0){
+                    if(errno == EINTR)
+                        continue;
+                    break;
+                }
+
+                // 设备被拔掉等错误时退出，否则 poll() 会一直立即返回
+                if(fds[1].revents || (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)))
+                    break;
+
+                read(*this);
+                notify();
+            }
+        });
+    }
+
+    /**
+     * @brief 停止并等待接收线程退出。
+     */
+    void stop(){
+        if(thread_.joinable()){
+            std::uint64_t one = 1;
+            [[maybe_unused]] auto n = ::write(wake_, &one, sizeof(one));
+            thread_.join();
+        }
+
+        if(wake_ >= 0){
+            ::close(wake_);
+            wake_ = -1;
+        }
+    }
+
+    /**
+     * @brief 获取下一个可写的槽位，队列已满时返回 nullptr 并计入 overruns()。仅在接收线程中调用。
+     */
+    inline Frame* prepare(){
+        auto slot = ring_.prepare();
+        if(!slot)
+            overruns_.fetch_add(1, std::memory_order_relaxed);
+        return slot;
+    }
+
+    /**
+     * @brief 提交 prepare() 得到的槽位。仅在接收线程中调用。
+     */
+    inline void commit(){ ring_.commit(); }
+
+    /**
+     * @brief 取出并清零队列满时丢弃的帧数。
+     */
+    inline std::uint64_t take_overruns(){
+        if(overruns_.load(std::memory_order_relaxed) == 0)
+            return 0;
+        return overruns_.exchange(0, std::memory_order_relaxed);
+    }
+
+    inline bool running() const { return thread_.joinable(); }
+
+private:
+    // posted_ 与队列下标之间需要全序：接收线程先提交帧再检查 posted_，任务上下文先清除 posted_ 再检查队列，
+    // 两边都加上 seq_cst 栅栏，保证不会出现帧已经入队、却没有人去取的情况。
+    inline void notify(){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!posted_.exchange(true, std::memory_order_acq_rel))
+            asio::post(executor_, [this]{ drain(); });
+    }
+
+    inline void drain(){
+        posted_.store(false, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        while(auto frame = ring_.front()){
+            handle_(*frame);
+            ring_.pop();
+        }
+    }
+
+    decltype(roboctrl::executor()) executor_;
+    utils::spsc_ring<Frame,Capacity> ring_;
+    std::function<void(Frame&)> handle_;
+    std::atomic<std::uint64_t> overruns_{0};
+    std::atomic<bool> posted_{false};
+    std::thread thread_;
+    int wake_ = -1;
+};
+
+}
@@ -7,25 +7,45 @@
 
 #include <array>
 #include <asio.hpp>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <format>
 #include <span>
 #include <string_view>
 #include <utility>
+#include <variant>
+#include <vector>
 
 #include "core/async.hpp"
+#include "core/logger.h"
 #include "io/base.hpp"
+#include "io/rx_thread.hpp"
+#include "io/tx_queue.hpp"
 #include "utils/concepts.hpp"
+#include "utils/crc.hpp"
 #include "utils/utils.hpp"
 
 namespace roboctrl::io{
 
+/**
+ * @brief 串口低延迟参数，作为 serial::info_type 中的 latency 字段。
+ * @details 默认的 USB 转串口驱动会把数据攒到延迟定时器（FTDI 为 16ms）到期再上报，1kHz 的 IMU 数据因此会成团到达。
+ * 开启 low_latency 后驱动收到数据就立即上报。
+ */
+struct serial_latency_options{
+    bool low_latency = false;   ///< 是否开启驱动的 ASYNC_LOW_LATENCY，驱动不支持时只输出警告
+    std::uint8_t vmin = 1;      ///< termios 的 VMIN，read() 至少等到这么多字节才返回
+    std::uint8_t vtime = 0;     ///< termios 的 VTIME，字节间的超时，单位 0.1s，0 表示不超时
+    bool exclusive = false;     ///< 是否用 TIOCEXCL 独占串口，防止调试工具同时打开它
+};
 
 /**
  * @brief 串口设备对象。
  */
-class serial : public keyed_io_base<uint8_t>{
+class serial : public keyed_io_base<uint8_t>,public logable<serial>{
 public:
     /**
      * @brief 串口初始化参数。
@@ -36,7 +56,11 @@ public:
 
         std::string_view name;
         std::string_view device;
-        unsigned int baud_rate;
+        unsigned int baud_rate;     ///< 波特率，可以是 1500000、2000000 等非标准值
+        tx_options tx{};            ///< 发送队列参数
+        rx_thread_options rx_thread{};  ///< 是否在独立线程中接收，见 roboctrl::io::rx_thread
+        bool crc = false;           ///< 收到的帧末尾是否带 CRC16（utils::crc16），校验失败的帧在分发前丢弃；现有下位机不发送 CRC，需要时显式开启
+        serial_latency_options latency{};   ///< 低延迟参数
 
         std::string_view key()const{
             return name;
@@ -51,12 +75,24 @@ public:
     explicit serial(info_type info);
 
     /**
-     * @brief 发送字节数据。
+     * @brief 发送一帧带 key 的数据。
+     * @details 数据放进发送队列后立即返回。写协程把积压的每一帧封装成
+     * `0x55 0xAA`、1 字节 key、2 字节数据长度、数据、2 字节 CRC16（对前面所有字节计算），多字节字段均为小端，
+     * 全部写进同一块预先分配的缓冲，再用一次写入发出。数据不能超过 65535 字节。
      */
     awaitable<void> send(key_type key,byte_span data);
 
+    /**
+     * @brief 一次发送多帧，这些帧会被封装进同一块缓冲，在同一次写入中发出。
+     * @details 适合在一个控制周期中把发给下位机的全部指令一起发出。
+     */
+    awaitable<void> send_batch(std::span<const std::pair<key_type,byte_span>> frames);
+
     /**
      * @brief 接收循环任务。
+     * @details 每次用一次 read_some() 读出串口中已有的全部数据，交给 combined_parser 拆出所有完整的帧。
+     * 遇到错误的帧头或者校验失败时，解析器用 memchr() 直接找到下一个可能的帧头，一段连续的错误数据只计一次解析失败。
+     * 开启 info_type::rx_thread 时不启动这个任务，改为在独立线程中读取和拆帧，回调仍在任务上下文中执行。
      */
     awaitable<void> task();
 
@@ -64,20 +100,101 @@ public:
         return std::format("serial port ({} on {} @ {}bps)",info_.name,info_.device,info_.baud_rate);
     }
 private:
-    awaitable<void> read_n(size_t size);
+    static constexpr std::size_t rx_frame_size = 1024;
+
+    /**
+     * @brief 独立接收线程交给任务上下文的一帧。
+     */
+    struct rx_frame{
+        key_type key;
+        std::uint16_t size;
+        std::chrono::nanoseconds time;
+        std::array<std::byte,rx_frame_size> data;
+    };
+
+    /**
+     * @brief 在接收线程中读取串口并拆出完整的帧。
+     */
+    void receive(rx_thread<rx_frame,64>& rx);
+
+    /**
+     * @brief key 字段的解析器，后面数据字段的长度是这个 key 注册的包长度。
+     * @details 包长度从 rx_sizes_ 中读取，接收线程中也可以使用。超过 rx_frame_size 的长度视为无效帧。
+     */
+    struct key_data{
+        using data_type = key_type;
+
+        static constexpr std::size_t size = sizeof(key_type);
+
+        bool parse(byte_span,byte_span field){
+            key_ = static_cast<key_type>(field[0]);
+            length_ = (*sizes_)[key_].load(std::memory_order_relaxed);
+            return length_ <= rx_frame_size;
+        }
+
+        data_type data(){
+            return key_;
+        }
+
+        std::size_t length() const{
+            return length_;
+        }
+
+        const std::array<std::atomic<std::uint16_t>,256>* sizes_ = nullptr;
+        key_type key_ = 0;
+        std::size_t length_ = 0;
+    };
+
+    using rx_header = fixed_data<std::byte{0x55},std::byte{0xAA}>;
+
+    /**
+     * 接收的帧格式为 `0x55 0xAA`、1 字节 key、这个 key 注册的包长度的数据；开启 info_type::crc 时，
+     * 最后是对前面所有字节计算的 2 字节 CRC16（小端）。
+     */
+    using rx_parser = std::variant<
+        combined_parser<rx_header,key_data,other_all>,
+        combined_parser<rx_header,key_data,other_all,checksum_data<utils::crc16>>
+    >;
+
+    /**
+     * @brief 根据 info_type::crc 创建接收帧的解析器。
+     */
+    rx_parser make_rx_parser();
 
-    template<utils::package pkg_type>
-    awaitable<pkg_type> read(){
-        co_await read_n(sizeof(pkg_type));
-        co_return utils::from_bytes<pkg_type>(byte_span{buffer_.data(),sizeof(pkg_type)});
+    /**
+     * @brief 把读到的数据喂给 rx_parser_，对每一帧以 `(key_type, byte_span)` 调用 emit。
+     * @return 这次新增的解析失败次数
+     */
+    template<typename Emit>
+    std::uint64_t parse(byte_span data,Emit&& emit){
+        return std::visit([&](auto& parser) -> std::uint64_t{
+            auto failures = parser.failures();
+            parser.feed(data, [&](byte_span){
+                emit(parser.template data<1>(), parser.template data<2>());
+            });
+            return parser.failures() - failures;
+        }, rx_parser_);
     }
 
+    awaitable<void> write(std::span<tx_queue<key_type>::entry> batch);
+
 private:
     asio::serial_port port_;
     info_type info_;
-    std::array<std::byte,1024> buffer_;
+    tx_queue<key_type> tx_;
+    std::vector<std::byte> tx_buffer_;     ///< 写协程封装帧的缓冲，只增不减，稳态下不会分配内存
+
+    // 接收线程拆帧时不能访问 key 表，注册回调时把每个 key 的包长度同步到这里，两种接收方式共用
+    std::array<std::atomic<std::uint16_t>,256> rx_sizes_{};
+    std::atomic<std::uint64_t> rx_failures_{0};
+    // 跨越两次读取的帧由解析器自己暂存，读缓冲只需要放下一次读到的数据
+    std::array<std::byte,rx_frame_size> rx_buffer_;
+    rx_parser rx_parser_;
+    rx_thread<rx_frame,64> rx_thread_;
 
     static constexpr uint16_t header_magic = 0xAA55;
+    static constexpr std::size_t header_size = 3;
+    static constexpr std::size_t tx_header_size = 5;
 };
 
 static_assert(keyed_io<serial>);
@@ -0,0 +1,36 @@
+/**
+ * @file serial_termios.h
+ * @brief 串口的底层 termios 设置。
+ * @details asio 的串口选项只支持标准波特率，也不能设置驱动的低延迟模式。这里的函数直接对文件描述符调用 ioctl，
+ * 实现放在单独的源文件中，因为 termios2 所在的 `<asm/termbits.h>` 不能和 asio 使用的 `<termios.h>` 同时包含。
+ *
+ * 所有函数失败时返回 false，错误原因保存在 errno 中。
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace roboctrl::io::details{
+
+/**
+ * @brief 通过 termios2 的 BOTHER 设置任意波特率，例如 1500000、2000000。
+ */
+bool set_custom_baud_rate(int fd,unsigned int baud_rate);
+
+/**
+ * @brief 通过 TIOCSSERIAL 开启驱动的 ASYNC_LOW_LATENCY 标志。
+ * @details 对 FTDI 等 USB 转串口芯片，这会把驱动的延迟定时器从默认的 16ms 降到 1ms。
+ */
+bool set_low_latency(int fd);
+
+/**
+ * @brief 设置非规范模式下 read() 的 VMIN 和 VTIME。
+ */
+bool set_read_timing(int fd,std::uint8_t vmin,std::uint8_t vtime);
+
+/**
+ * @brief 通过 TIOCEXCL 独占串口，之后其他进程再打开会失败。
+ */
+bool set_exclusive(int fd);
+
+}
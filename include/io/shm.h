@@ -0,0 +1,157 @@
+/**
+ * @file shm.h
+ * @brief 共享内存裸 IO 封装。
+ * @details 同一台电脑上的两个进程（例如电控和自瞄）通过 POSIX 共享内存中的一对单生产者单消费者环形队列通信。
+ * 发送只是把数据拷进共享内存，不需要系统调用；对端空闲时才用一次 futex 唤醒它。
+ */
+#pragma once
+
+#include <asio.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <span>
+#include <string_view>
+#include <thread>
+
+#include "core/async.hpp"
+#include "io/base.hpp"
+#include "core/logger.h"
+
+namespace roboctrl::io{
+
+/// @cond INTERNAL
+namespace details{
+
+/**
+ * 共享内存中一个方向的环形队列的控制块，数据区紧跟在全部控制块之后。
+ * 每条记录是 4 字节小端的长度加数据，按 8 字节对齐；数据区末尾放不下一条记录时写一个 shm_wrap_marker，从头开始写。
+ */
+struct shm_ring{
+    alignas(64) std::atomic<std::uint64_t> head;    ///< 写位置，只由生产者修改
+    alignas(64) std::atomic<std::uint64_t> tail;    ///< 读位置，只由消费者修改
+    alignas(64) std::atomic<std::uint32_t> seq;     ///< 每写入一条记录加一，消费者在它上面 futex 等待
+    std::atomic<std::uint32_t> waiters;             ///< 正在等待的消费者数，为 0 时生产者不需要唤醒
+};
+
+/**
+ * 共享内存的头部。
+ */
+struct shm_header{
+    static constexpr std::uint64_t magic_value = 0x314d485343524b47; // "GKRCSHM1"
+
+    std::atomic<std::uint64_t> magic;   ///< 创建方初始化完成后最后写入
+    std::uint64_t capacity;             ///< 每个方向数据区的字节数
+    alignas(64) shm_ring rings[2];      ///< rings[0] 由创建方写入，rings[1] 由打开方写入
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+    "shared memory rings need address-free atomics");
+
+}
+/// @endcond
+
+/**
+ * @brief 共享内存通信端点。
+ * @details 一方以 create = true 创建共享内存，另一方以 create = false 打开同名的共享内存，两边各写一个方向的队列。
+ * 对端不在运行或者处理不过来、队列已满时，新数据会被丢弃并计入 tx_dropped，不会阻塞电控。
+ * 接收由一个等待线程负责：它在 futex 上睡眠，对端写入后被唤醒，再让任务上下文中的接收任务读出数据并分发，
+ * 回调仍然只在任务上下文中执行。
+ *
+ * ```cpp
+ * constexpr std::initializer_list<io::shm::info_type> shms = {
+ *     {"autoaim","/roboctrl_autoaim"}
+ * };
+ * ```
+ */
+class shm : public bare_io_base,public logable<shm>{
+public:
+    /**
+     * @brief 共享内存初始化参数。
+     */
+    struct info_type{
+        using key_type = std::string_view;
+        using owner_type = shm;
+
+        std::string_view key_;
+        std::string_view path;                  ///< 共享内存名称，以 / 开头，例如 "/roboctrl_autoaim"
+        bool create = true;                     ///< 是否由这一方创建共享内存，对端应为 false
+        std::size_t capacity = 1 << 20;         ///< 每个方向的队列字节数，必须是 2 的幂，只由创建方决定
+        int cpu = -1;                           ///< 等待线程绑定的 CPU 核，-1 表示不绑定
+
+        std::string_view key()const{
+            return key_;
+        }
+    };
+
+    explicit shm(info_type info);
+    ~shm();
+
+    /**
+     * @brief 发送一段字节数据。
+     * @details 数据直接写进共享内存，队列已满时丢弃。一帧最多 capacity / 4 字节，更长时抛出 std::length_error。
+     */
+    awaitable<void> send(byte_span data);
+
+    /**
+     * @brief 把分散的几段数据作为一帧发送。
+     */
+    awaitable<void> send(std::span<const byte_span> parts);
+
+    /**
+     * @brief 接收循环任务。
+     */
+    awaitable<void> task();
+
+    inline std::string desc()const{
+        return std::format("shared memory ({} at {})",info_.key_,info_.path);
+    }
+
+private:
+    /**
+     * @brief 打开并映射共享内存，失败时抛出异常。
+     */
+    void map();
+
+    /**
+     * @brief 解除映射并关闭共享内存，创建方还会删除它。
+     */
+    void unmap();
+
+    /**
+     * @brief 把数据写进发送队列。
+     * @return 队列已满时返回 false
+     */
+    bool write(std::span<const byte_span> parts,std::size_t size);
+
+    /**
+     * @brief 读出接收队列中的全部数据并分发。
+     */
+    void drain();
+
+    /**
+     * @brief 等待线程的主循环。
+     */
+    void wait();
+
+    inline std::size_t max_frame()const{ return capacity_ / 4; }
+
+    info_type info_;
+    int fd_ = -1;
+    void* map_ = nullptr;
+    std::size_t map_size_ = 0;
+    std::size_t capacity_ = 0;
+    details::shm_ring* tx_ = nullptr;
+    details::shm_ring* rx_ = nullptr;
+    std::byte* tx_data_ = nullptr;
+    std::byte* rx_data_ = nullptr;
+    std::uint64_t tx_tail_cache_ = 0;
+    asio::steady_timer timer_;
+    std::atomic<bool> waiting_{false};
+    std::atomic<bool> stopping_{false};
+    std::thread waiter_;
+};
+
+static_assert(bare_io<shm>);
+}
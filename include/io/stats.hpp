@@ -0,0 +1,99 @@
+/**
+ * @file io/stats.hpp
+ * @brief IO 的流量与分发延迟统计。
+ * @details IO 基类在分发和发送数据时会自动记录收发的帧数与字节数、未知 key 的丢弃数、解析失败数、发送错误数，
+ * 以及从读取完成到回调执行完毕的延迟分布。可以通过 IO 对象的 stats() 查询，也可以通过
+ * roboctrl::io::stats_reporter 周期性地输出到日志。
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace roboctrl::io{
+
+/**
+ * @brief 收发流量统计。
+ */
+struct traffic_stats{
+    std::uint64_t rx_frames = 0;    ///< 收到的帧数
+    std::uint64_t rx_bytes = 0;     ///< 收到的字节数
+    std::uint64_t tx_frames = 0;    ///< 发送的帧数
+    std::uint64_t tx_bytes = 0;     ///< 发送的字节数
+};
+
+/**
+ * @brief 延迟直方图。
+ * @details 按 2 的幂划分桶：第 0 个桶统计小于 1us 的样本，第 i 个桶统计 [2^(i-1), 2^i) us 的样本，
+ * 最后一个桶统计所有更大的样本。记录一个样本只需要几次整数运算。
+ */
+class latency_histogram{
+public:
+    static constexpr std::size_t bucket_count = 16;
+
+    /**
+     * @brief 记录一个样本。
+     */
+    inline void record(std::chrono::nanoseconds latency){
+        auto us = static_cast<std::uint64_t>(std::max<std::int64_t>(latency.count(), 0) / 1000);
+        auto index = std::min<std::size_t>(std::bit_width(us), bucket_count - 1);
+        ++buckets_[index];
+        ++count_;
+        sum_ += latency;
+        max_ = std::max(max_, latency);
+    }
+
+    inline std::uint64_t count() const { return count_; }
+    inline std::chrono::nanoseconds max() const { return max_; }
+
+    inline std::chrono::nanoseconds mean() const {
+        return count_ == 0 ? std::chrono::nanoseconds{0} : sum_ / static_cast<std::int64_t>(count_);
+    }
+
+    /**
+     * @brief 估计分位数，返回分位数所在桶的上界。
+     * @param p 分位，范围 [0,1]
+     */
+    inline std::chrono::nanoseconds percentile(double p) const {
+        if(count_ == 0)
+            return std::chrono::nanoseconds{0};
+
+        auto target = static_cast<std::uint64_t>(p * static_cast<double>(count_));
+        std::uint64_t seen = 0;
+        for(std::size_t i = 0; i < bucket_count - 1; ++i){
+            seen += buckets_[i];
+            if(seen > target)
+                return std::chrono::microseconds{std::int64_t{1} << i};
+        }
+        return max_;
+    }
+
+    inline const std::array<std::uint64_t,bucket_count>& buckets() const { return buckets_; }
+
+    inline void reset(){ *this = {}; }
+
+private:
+    std::array<std::uint64_t,bucket_count> buckets_{};
+    std::uint64_t count_ = 0;
+    std::chrono::nanoseconds sum_{0};
+    std::chrono::nanoseconds max_{0};
+};
+
+/**
+ * @brief 一个 IO 对象的统计信息。
+ */
+struct io_stats{
+    traffic_stats traffic;              ///< 总流量
+    std::uint64_t unknown_keys = 0;     ///< 因为没有对应 key 的回调而丢弃的帧数
+    std::uint64_t parse_failures = 0;   ///< 解析失败的次数
+    std::uint64_t send_errors = 0;      ///< 发送失败的次数
+    std::uint64_t tx_dropped = 0;       ///< 因为发送队列已满而丢弃的帧数
+    std::uint64_t rx_dropped = 0;       ///< 因为独立接收线程的队列已满而丢弃的帧数
+    latency_histogram latency;          ///< 从读取完成到回调执行完毕的延迟
+};
+
+}
@@ -0,0 +1,63 @@
+/**
+ * @file stats_reporter.h
+ * @brief IO 统计信息的周期性输出。
+ * @details 初始化后会按给定的周期，把所有 can、serial、udp、tcp、shm 多例对象的统计信息输出到日志，
+ * 用于在比赛负载下找出哪条总线已经饱和。
+ */
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+#include "core/async.hpp"
+#include "core/logger.h"
+#include "io/stats.hpp"
+#include "utils/singleton.hpp"
+
+using namespace std::chrono_literals;
+
+namespace roboctrl::io{
+
+/**
+ * @brief IO 统计信息输出器。
+ * @details 示例：
+ *
+ * ```cpp
+ * roboctrl::init(roboctrl::io::stats_reporter::info_type{.period = 5s});
+ * ```
+ *
+ * 每个 IO 输出一行汇总，包括收发帧率与带宽、未知 key 丢弃数、解析失败数、发送错误数和分发延迟；
+ * 带 key 的 IO 还会在 debug 等级下输出每个 key 的流量。
+ */
+class stats_reporter : public utils::singleton_base<stats_reporter>,public logable<stats_reporter>{
+public:
+    struct info_type{
+        using owner_type = stats_reporter;
+
+        std::chrono::steady_clock::duration period = 1s;   ///< 输出周期
+    };
+
+    bool init(const info_type& info);
+
+    inline std::string desc()const{return "io stats";}
+
+    /**
+     * @brief 立即输出一次全部 IO 的统计信息。
+     */
+    void dump();
+
+    awaitable<void> task();
+
+private:
+    template<typename T>
+    void report(T& io,double elapsed);
+
+    info_type info_;
+    std::chrono::nanoseconds last_dump_{};
+    std::unordered_map<std::string,traffic_stats> last_;
+};
+
+static_assert(utils::singleton<stats_reporter>);
+
+}
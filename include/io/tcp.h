@@ -16,7 +16,10 @@
 #include <vector>
 
 #include "core/async.hpp"
+#include "core/logger.h"
 #include "io/base.hpp"
+#include "io/framing.hpp"
+#include "io/tx_queue.hpp"
 #include "utils/callback.hpp"
 
 namespace roboctrl::io{
@@ -24,7 +27,7 @@ namespace roboctrl::io{
 /**
  * @brief TCP 客户端套接字。
  */
-class tcp : public bare_io_base{
+class tcp : public bare_io_base,public logable<tcp>{
 public:
     /**
      * @brief TCP 连接参数。
@@ -36,6 +39,9 @@ public:
         std::string name;       ///< TCP 连接名称
         std::string address;    ///< TCP 连接地址
         std::uint16_t port;     ///< TCP 端口
+        tx_options tx{};        ///< 发送队列参数
+        stream_framing framing = stream_framing::none;  ///< 分帧方式，对端需要使用相同的方式
+        std::size_t max_frame = 1 << 20;                ///< 允许接收的最大帧长，超过时断开连接
 
         std::string_view key()const{
             return name;
@@ -49,35 +55,71 @@ public:
     /**
      * @brief 由已有 `asio::ip::tcp::socket` 包装。
      */
-    tcp(asio::ip::tcp::socket socket, std::string key);
+    tcp(asio::ip::tcp::socket socket, std::string key, stream_framing framing = stream_framing::none, std::size_t max_frame = 1 << 20, tx_options tx = {});
 
     /**
-     * @brief 发送字节数据。
+     * @brief 发送一帧数据。
+     * @details 数据放进发送队列后立即返回，写协程会把积压的全部数据合并成一次写入。开启分帧时会在数据前加上长度前缀。
      */
     awaitable<void> send(byte_span data);
 
+    /**
+     * @brief 把分散的几段数据作为一帧发送，省去调用者自己拼接。
+     * @details 开启分帧时最多 7 段。
+     */
+    awaitable<void> send(std::span<const byte_span> parts);
+
     /**
      * @brief 接收循环任务。
+     * @details 数据直接读进可增长的接收缓冲。不分帧时每次读到的数据原样分发；开启分帧时拆出缓冲中所有完整的帧，
+     * 逐帧分发缓冲中对应的那一段，半条消息留到下次读取后再拆。收到超过 max_frame 的帧时关闭连接。
+     * 对端关闭或读取出错时关闭连接，等写协程退出后触发 on_close 回调并返回。
      */
     awaitable<void> task();
 
+    /**
+     * @brief 关闭连接，接收任务随后返回。
+     */
+    void close();
+
+    /**
+     * @brief 连接是否仍然打开。
+     */
+    inline bool is_open()const{ return socket_.is_open(); }
+
+    /**
+     * @brief 注册连接关闭时的回调。
+     */
+    inline void on_close(callback_fn<> auto fn){
+        on_close_.add(std::move(fn));
+    }
+
     inline std::string desc()const{
         return std::format("tcp socket (<{}> to {}:{})",info_.name,info_.address,info_.port);
     }
 
 private:
+    friend class tcp_server;
+
+    awaitable<void> write(std::span<tx_queue<>::entry> batch);
+    awaitable<void> read();
+
     asio::ip::tcp::socket socket_;
     info_type info_;
-    std::array<std::byte,1024> buffer_;
+    stream_buffer rx_;
+    tx_queue<> tx_;
+    std::vector<asio::const_buffer> gather_;
+    callback<> on_close_;
 };
 
 static_assert(bare_io<tcp>);
 
 /**
  * @brief TCP 监听服务器，负责接受并管理多连接。
- * @details 在创建后，tcp_server 会监听指定端口，当新连接建立时，会创建新 roboctrl::io::tcp 的调用通过 on_connect 方法注册的回调函数
+ * @details 在创建后，tcp_server 会监听指定端口，当新连接建立时，会创建新 roboctrl::io::tcp 的调用通过 on_connect 方法注册的回调函数。
+ * 连接关闭后会从服务器中移除。
  */
-class tcp_server{
+class tcp_server : public logable<tcp_server>{
 public:
     /**
      * @brief 服务器初始化参数。
@@ -89,6 +131,9 @@ public:
         std::string name;                   ///< 服务器名称
         std::string address;                ///< 监听地址
         std::uint16_t port;                 ///< 监听端口
+        stream_framing framing = stream_framing::none;  ///< 连接的分帧方式，见 tcp::info_type::framing
+        std::size_t max_frame = 1 << 20;                ///< 连接允许接收的最大帧长
+        tx_options tx{};                                ///< 每个连接的发送队列参数，broadcast() 时队列已满的连接会被断开
 
         std::string_view key()const{
             return name;
@@ -100,6 +145,18 @@ public:
      */
     explicit tcp_server(info_type info);
 
+    /**
+     * @brief 把同一帧发给所有连接。
+     * @details 数据连同长度前缀只拷贝一次到一个帧缓冲，各连接的发送队列共享这个缓冲。
+     * 发送队列已满的连接说明对端跟不上，直接断开，不会阻塞其他连接和电控。
+     */
+    awaitable<void> broadcast(byte_span data);
+
+    /**
+     * @brief 当前的连接数。
+     */
+    inline std::size_t connections()const{ return connections_.size(); }
+
     /**
      * @brief 接受连接的长任务。
      */
@@ -126,9 +183,15 @@ public:
 private:
     std::shared_ptr<tcp> make_connection(asio::ip::tcp::socket socket);
 
+    /**
+     * @brief 运行一个连接的接收任务，连接关闭后把它移除。协程帧持有连接，保证连接在任务返回前不会析构。
+     */
+    awaitable<void> serve(std::shared_ptr<tcp> connection);
+
     asio::ip::tcp::acceptor acceptor_;
     info_type info_;
     callback<std::shared_ptr<tcp>> on_connect_;
     std::vector<std::shared_ptr<tcp>> connections_;
+    std::size_t accepted_ = 0;
 };
 }
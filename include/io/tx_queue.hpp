@@ -0,0 +1,280 @@
+/**
+ * @file tx_queue.hpp
+ * @brief IO 的发送队列。
+ * @details 每个 IO 持有一个有界的发送队列和一个唯一的写协程：send() 只把数据放进队列就返回，不等待内核；
+ * 写协程每次取出当前积压的全部数据，在介质允许时合并成一次系统调用写出。因为只有一个写协程，
+ * 同一个串口或 socket 上不会再出现多个协程交错写入的情况。
+ */
+#pragma once
+
+#include <asio.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "core/async.hpp"
+#include "io/frame_pool.h"
+#include "utils/concepts.hpp"
+
+namespace roboctrl::io{
+
+/**
+ * @brief 发送队列满时的丢弃策略。
+ */
+enum class drop_policy : std::uint8_t{
+    drop_newest,    ///< 丢弃新来的数据
+    drop_oldest,    ///< 丢弃队列中最旧的数据
+    latest_wins     ///< 队列中已有相同 key 的数据时直接用新数据替换，适合马达指令这类只关心最新值的数据；否则同 drop_oldest
+};
+
+/**
+ * @brief 发送优先级。
+ * @details 写协程每次取出积压的数据时，按优先级从高到低排列，同一优先级内保持入队顺序；
+ * 队列满时优先丢弃优先级最低的数据。
+ */
+enum class tx_priority : std::uint8_t{
+    command = 0,    ///< 控制指令，例如马达电流
+    normal = 1,     ///< 默认优先级
+    telemetry = 2   ///< 遥测、调试数据，总线繁忙时可以被丢弃
+};
+
+/**
+ * @brief 发送队列参数，作为各个 IO 的 info_type 中的 tx 字段。
+ */
+struct tx_options{
+    std::size_t depth = 64;                         ///< 队列深度
+    drop_policy policy = drop_policy::drop_oldest;  ///< 丢弃策略
+};
+
+/**
+ * @brief 有界发送队列。
+ * @details 队列的槽位在构造时一次性分配，数据保存在 frame_pool 的帧缓冲中，稳态下入队不会分配内存。
+ * 和整个电控一样，发送队列只应在任务上下文所在的线程中使用。
+ *
+ * IO 在构造时启动 run()，传入一个把一批数据写到介质上的协程函数：
+ *
+ * ```cpp
+ * roboctrl::spawn(tx_.run([this](std::span<tx_queue<>::entry> batch) -> awaitable<void>{
+ *     // 把 batch 中的数据写出去
+ * }));
+ * ```
+ *
+ * @tparam TK key 类型，裸 IO 使用 std::monostate
+ */
+template<typename TK = std::monostate>
+class tx_queue : public utils::immovable_base, public utils::not_copyable_base{
+public:
+    /**
+     * @brief 队列中的一条数据。
+     */
+    struct entry{
+        TK key{};
+        frame_buffer data;
+        std::uint8_t flags = 0;     ///< 与介质相关的标志，例如 CAN FD 帧的 BRS
+        tx_priority priority = tx_priority::normal;
+    };
+
+    explicit tx_queue(const tx_options& options = {})
+        : options_{options},
+        slots_(options.depth == 0 ? 1 : options.depth),
+        timer_{roboctrl::executor(), asio::steady_timer::time_point::max()}
+    {
+        batch_.reserve(slots_.size());
+    }
+
+    /**
+     * @brief 把数据放进队列。
+     * @param flags 与介质相关的标志，原样交给写协程
+     * @param priority 发送优先级
+     * @return 是否有数据因为队列已满被丢弃（可能是新数据，也可能是队列中的旧数据）
+     */
+    inline bool push(const TK& key,std::span<const std::byte> data,std::uint8_t flags = 0,tx_priority priority = tx_priority::normal){
+        return emplace(key, flags, priority, [&]{
+            auto buffer = frame_pool::local().acquire(data.size());
+            if(!data.empty())
+                std::memcpy(buffer.data(), data.data(), data.size());
+            return buffer;
+        });
+    }
+
+    /**
+     * @brief 把已有的帧缓冲放进队列，只增加引用计数，不拷贝数据。
+     * @details 用于把同一帧发给多个 IO，例如 tcp_server::broadcast()。
+     * @return 是否有数据因为队列已满被丢弃
+     */
+    inline bool push(const TK& key,frame_buffer data,std::uint8_t flags = 0,tx_priority priority = tx_priority::normal){
+        return emplace(key, flags, priority, [&]{ return std::move(data); });
+    }
+
+    /**
+     * @brief 把分散的几段数据拼成一帧放进队列。
+     * @return 是否有数据因为队列已满被丢弃
+     */
+    inline bool push(const TK& key,std::span<const std::span<std::byte>> parts){
+        std::size_t size = 0;
+        for(auto part : parts)
+            size += part.size();
+
+        return emplace(key, 0, tx_priority::normal, [&]{
+            auto buffer = frame_pool::local().acquire(size);
+            auto out = buffer.data();
+            for(auto part : parts){
+                if(!part.empty())
+                    std::memcpy(out, part.data(), part.size());
+                out += part.size();
+            }
+            return buffer;
+        });
+    }
+
+    /**
+     * @brief 写协程，直到 close() 后才返回。
+     * @param write 接受 `std::span<entry>` 并返回 awaitable<void> 的协程函数，需要自己处理发送错误
+     */
+    template<typename Fn>
+    awaitable<void> run(Fn write){
+        while(!closed_){
+            if(count_ == 0){
+                waiting_ = true;
+                asio::error_code ec;
+                timer_.expires_at(asio::steady_timer::time_point::max());
+                co_await timer_.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+                continue;
+            }
+
+            // 按优先级分几趟取出，同一优先级内保持入队顺序，不需要额外的排序缓冲
+            for(auto priority : {tx_priority::command, tx_priority::normal, tx_priority::telemetry}){
+                for(std::size_t i = 0; i < count_; ++i){
+                    if(at(i).priority == priority)
+                        batch_.push_back(std::move(at(i)));
+                }
+            }
+            head_ = (head_ + count_) % slots_.size();
+            count_ = 0;
+
+            co_await write(std::span<entry>{batch_});
+            batch_.clear();
+        }
+
+        stopped_ = true;
+    }
+
+    /**
+     * @brief 关闭队列。
+     * @details 丢弃排队的数据，写协程写完手上的这一批后返回，之后 push() 的数据都会被丢弃。
+     * IO 要在 stopped() 之后才能析构，否则写协程会访问已经析构的队列。
+     */
+    inline void close(){
+        closed_ = true;
+        for(std::size_t i = 0; i < count_; ++i)
+            at(i).data.reset();
+        head_ = 0;
+        count_ = 0;
+
+        if(waiting_){
+            waiting_ = false;
+            timer_.cancel();
+        }
+    }
+
+    /**
+     * @brief 写协程是否已经返回。
+     */
+    inline bool stopped() const { return stopped_; }
+
+    /**
+     * @brief 当前排队的数据条数。
+     */
+    inline std::size_t size() const { return count_; }
+
+    /**
+     * @brief 队列的槽位数，也是写协程一批最多取出的数据条数。
+     * @details 与 tx_options::depth 相同，只是 depth 为 0 时也有一个槽位，按批次预先分配缓冲时应以它为准。
+     */
+    inline std::size_t capacity() const { return slots_.size(); }
+
+    inline const tx_options& options() const { return options_; }
+
+private:
+    inline entry& at(std::size_t i){ return slots_[(head_ + i) % slots_.size()]; }
+
+    /**
+     * 从队列中移除第 index 条数据，前面的数据依次后移。
+     */
+    inline void erase(std::size_t index){
+        for(std::size_t i = index; i > 0; --i)
+            at(i) = std::move(at(i - 1));
+        at(0).data.reset();
+        head_ = (head_ + 1) % slots_.size();
+        --count_;
+    }
+
+    /**
+     * make() 返回要入队的帧缓冲，只在数据确实入队时调用。
+     */
+    template<typename Make>
+    bool emplace(const TK& key,std::uint8_t flags,tx_priority priority,Make&& make){
+        if(closed_)
+            return true;
+
+        if(options_.policy == drop_policy::latest_wins){
+            for(std::size_t i = 0; i < count_; ++i){
+                auto& slot = at(i);
+                if(slot.key == key){
+                    slot.data = make();
+                    slot.flags = flags;
+                    slot.priority = priority;
+                    return false;
+                }
+            }
+        }
+
+        bool dropped = false;
+        if(count_ == slots_.size()){
+            if(options_.policy == drop_policy::drop_newest)
+                return true;
+
+            // 丢弃优先级最低的数据中最旧的一条，如果新数据的优先级比它们都低，就丢弃新数据
+            std::size_t victim = 0;
+            for(std::size_t i = 1; i < count_; ++i){
+                if(at(i).priority > at(victim).priority)
+                    victim = i;
+            }
+            if(priority > at(victim).priority)
+                return true;
+
+            erase(victim);
+            dropped = true;
+        }
+
+        auto& slot = at(count_);
+        slot.key = key;
+        slot.flags = flags;
+        slot.priority = priority;
+        slot.data = make();
+        ++count_;
+
+        if(waiting_){
+            waiting_ = false;
+            timer_.cancel();
+        }
+
+        return dropped;
+    }
+
+    tx_options options_;
+    std::vector<entry> slots_;
+    std::vector<entry> batch_;
+    std::size_t head_ = 0;
+    std::size_t count_ = 0;
+    asio::steady_timer timer_;
+    bool waiting_ = false;
+    bool closed_ = false;
+    bool stopped_ = false;
+};
+
+}
@@ -5,20 +5,24 @@
  */
 #pragma once
 #include <asio.hpp>
+#include <cstddef>
 #include <format>
 #include <string_view>
 #include <span>
+#include <sys/socket.h>
+#include <vector>
 
 #include "core/async.hpp"
 #include "io/base.hpp"
 #include "core/logger.h"
+#include "io/tx_queue.hpp"
 
 namespace roboctrl::io{
 
 /**
  * @brief UDP 通信端点。
  */
-class udp : public bare_io_base{
+class udp : public bare_io_base,public logable<udp>{
 public:
     /**
      * @brief UDP 初始化参数。
@@ -30,6 +34,11 @@ public:
         std::string_view key_;
         std::string_view address;
         int port;
+        tx_options tx{};        ///< 发送队列参数
+        std::size_t max_datagram = 2048;    ///< 接收报文的最大字节数，更长的报文会被丢弃并计为解析失败
+        std::size_t rx_batch = 16;          ///< 每次可读时最多用一次 recvmmsg() 读取的报文数
+        bool gro = false;                   ///< 是否开启 UDP GRO，内核把连续的同长度报文合并后一次交上来
+        bool gso = false;                   ///< 是否开启 UDP GSO，连续的同长度报文合并成一次发送，由内核或网卡切分
 
         std::string_view key()const{
             return key_;
@@ -43,11 +52,19 @@ public:
 
     /**
      * @brief 异步发送一段字节数据。
+     * @details 数据放进发送队列后立即返回。写协程用一次 sendmmsg() 发出积压的全部报文，
+     * 开启 gso 时连续的同长度报文还会合并成一个 GSO 报文。
      */
     awaitable<void> send(byte_span data);
 
+    /**
+     * @brief 把分散的几段数据作为一帧发送，省去调用者自己拼接。
+     */
+    awaitable<void> send(std::span<const byte_span> parts);
+
     /**
      * @brief 接收循环任务。
+     * @details 每次 socket 可读时用一次 recvmmsg() 读出最多 info_type::rx_batch 个报文，逐个分发。
      */
     awaitable<void> task();
 
@@ -56,9 +73,26 @@ public:
     }
 
 private:
+  awaitable<void> write(std::span<tx_queue<>::entry> batch);
+
+  /**
+   * @brief 把 batch 中从 begin 开始的报文填进一个 mmsghdr，开启 GSO 时尽量合并多个报文。
+   * @return 这个 mmsghdr 包含的报文数
+   */
+  std::size_t fill_message(std::span<tx_queue<>::entry> batch,std::size_t begin,std::size_t index);
+
   asio::ip::udp::socket socket_;
   info_type info_;
-  std::array<std::byte,1024> buffer_;
+  std::size_t rx_slot_size_;
+  std::vector<std::byte> rx_buffer_;
+  std::vector<::iovec> rx_iovs_;
+  std::vector<::mmsghdr> rx_msgs_;
+  std::vector<std::byte> rx_control_;
+  tx_queue<> tx_;
+  std::vector<::iovec> tx_iovs_;
+  std::vector<::mmsghdr> tx_msgs_;
+  std::vector<std::size_t> tx_counts_;    ///< 每个 mmsghdr 包含的报文数
+  std::vector<std::byte> tx_control_;
 };
 
 static_assert(bare_io<udp>);
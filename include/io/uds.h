@@ -0,0 +1,214 @@
+/**
+ * @file uds.h
+ * @brief Unix 域套接字客户端与服务器封装。
+ * @details 用于同一台电脑上的调参界面、录制工具、自瞄等进程。与 TCP 回环相比没有协议栈的开销，
+ * SOCK_SEQPACKET 模式还保留消息边界，每次 send() 对端就收到完整的一帧，不需要分帧。
+ */
+#pragma once
+
+#include <asio.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "core/async.hpp"
+#include "core/logger.h"
+#include "io/base.hpp"
+#include "io/framing.hpp"
+#include "io/tx_queue.hpp"
+#include "utils/callback.hpp"
+
+namespace roboctrl::io{
+
+/**
+ * @brief Unix 域套接字的类型。
+ */
+enum class uds_mode : std::uint8_t{
+    stream,     ///< SOCK_STREAM，字节流，可以配合 stream_framing 分帧
+    seqpacket   ///< SOCK_SEQPACKET，保留消息边界，一次 send() 对应对端的一次回调
+};
+
+/**
+ * @brief Unix 域套接字客户端。
+ */
+class uds : public bare_io_base,public logable<uds>{
+public:
+    using stream_socket = asio::generic::stream_protocol::socket;
+    using seqpacket_socket = asio::generic::seq_packet_protocol::socket;
+
+    /**
+     * @brief Unix 域套接字连接参数。
+     */
+    struct info_type{
+        using key_type = std::string_view;
+        using owner_type = uds;
+
+        std::string name;       ///< 连接名称
+        std::string path;       ///< 套接字路径
+        uds_mode mode = uds_mode::seqpacket;            ///< 套接字类型，需要与服务器一致
+        tx_options tx{};        ///< 发送队列参数
+        stream_framing framing = stream_framing::none;  ///< stream 模式的分帧方式，对端需要使用相同的方式
+        std::size_t max_frame = 1 << 20;                ///< 允许接收的最大帧长，seqpacket 模式下更长的消息会被丢弃
+
+        std::string_view key()const{
+            return name;
+        }
+    };
+
+    /**
+     * @brief 通过连接信息构造客户端。
+     */
+    explicit uds(info_type info);
+
+    /**
+     * @brief 由已有的 stream 套接字包装。
+     */
+    uds(stream_socket socket, std::string key, std::string path, stream_framing framing = stream_framing::none, std::size_t max_frame = 1 << 20);
+
+    /**
+     * @brief 由已有的 seqpacket 套接字包装。
+     */
+    uds(seqpacket_socket socket, std::string key, std::string path, std::size_t max_frame = 1 << 20);
+
+    /**
+     * @brief 发送一帧数据。
+     * @details 数据放进发送队列后立即返回。stream 模式下写协程把积压的全部数据合并成一次写入，
+     * seqpacket 模式下每一帧都是一条单独的消息。
+     */
+    awaitable<void> send(byte_span data);
+
+    /**
+     * @brief 把分散的几段数据作为一帧发送。
+     * @details stream 模式开启分帧时最多 7 段。
+     */
+    awaitable<void> send(std::span<const byte_span> parts);
+
+    /**
+     * @brief 接收循环任务。
+     * @details stream 模式与 tcp 相同；seqpacket 模式每收到一条消息分发一次。对端关闭或出错时关闭连接，
+     * 等写协程退出后触发 on_close 回调并返回。
+     */
+    awaitable<void> task();
+
+    /**
+     * @brief 关闭连接，接收任务随后返回。
+     */
+    void close();
+
+    /**
+     * @brief 注册连接关闭时的回调。
+     */
+    inline void on_close(callback_fn<> auto fn){
+        on_close_.add(std::move(fn));
+    }
+
+    /**
+     * @brief 连接是否仍然打开。
+     */
+    inline bool is_open()const{
+        return info_.mode == uds_mode::stream ? stream_.is_open() : seqpacket_.is_open();
+    }
+
+    inline std::string desc()const{
+        return std::format("unix socket (<{}> {} at {})",info_.name,info_.mode == uds_mode::stream ? "stream" : "seqpacket",info_.path);
+    }
+
+private:
+    awaitable<void> write(std::span<tx_queue<>::entry> batch);
+    awaitable<void> read_stream();
+    awaitable<void> read_seqpacket();
+
+    info_type info_;
+    stream_socket stream_;
+    seqpacket_socket seqpacket_;
+    stream_buffer rx_;
+    std::vector<std::byte> packet_;
+    tx_queue<> tx_;
+    std::vector<asio::const_buffer> gather_;
+    callback<> on_close_;
+};
+
+static_assert(bare_io<uds>);
+
+/**
+ * @brief Unix 域套接字监听服务器。
+ * @details 创建后立即开始监听，新连接建立时创建 roboctrl::io::uds 并调用通过 on_connect 注册的回调函数。
+ * 连接关闭后会从服务器中移除。套接字路径上已有的文件会被删除，服务器析构时也会删除它。
+ */
+class uds_server : public logable<uds_server>{
+public:
+    /**
+     * @brief 服务器初始化参数。
+     */
+    struct info_type{
+        using key_type = std::string_view;
+        using owner_type = uds_server;
+
+        std::string name;                   ///< 服务器名称
+        std::string path;                   ///< 套接字路径
+        uds_mode mode = uds_mode::seqpacket;            ///< 套接字类型
+        stream_framing framing = stream_framing::none;  ///< stream 模式连接的分帧方式，见 uds::info_type::framing
+        std::size_t max_frame = 1 << 20;                ///< 连接允许接收的最大帧长
+
+        std::string_view key()const{
+            return name;
+        }
+    };
+
+    /**
+     * @brief 构造监听器并立即开始监听。
+     */
+    explicit uds_server(info_type info);
+    ~uds_server();
+
+    /**
+     * @brief 接受连接的长任务。
+     */
+    awaitable<void> task();
+
+    /**
+     * @brief 注册协程回调，在新连接建立时触发。
+     */
+    void on_connect(std::function<awaitable<void>(std::shared_ptr<uds>)> callback){
+        on_connect_.add(std::move(callback));
+    }
+
+    /**
+     * @brief 注册同步回调，在新连接建立时触发。
+     */
+    void on_connect(std::function<void(std::shared_ptr<uds>)> callback){
+        on_connect_.add(std::move(callback));
+    }
+
+    inline std::string desc()const{
+        return std::format("unix socket server (<{}> listening on {})",info_.name,info_.path);
+    }
+
+private:
+    template<typename Protocol>
+    using acceptor_type = asio::basic_socket_acceptor<Protocol>;
+
+    template<typename Protocol>
+    void listen(acceptor_type<Protocol>& acceptor);
+
+    template<typename Protocol>
+    awaitable<void> accept(acceptor_type<Protocol>& acceptor);
+
+    /**
+     * @brief 运行一个连接的接收任务，连接关闭后把它移除。
+     */
+    awaitable<void> serve(std::shared_ptr<uds> connection);
+
+    info_type info_;
+    acceptor_type<asio::generic::stream_protocol> stream_acceptor_;
+    acceptor_type<asio::generic::seq_packet_protocol> seqpacket_acceptor_;
+    callback<std::shared_ptr<uds>> on_connect_;
+    std::vector<std::shared_ptr<uds>> connections_;
+    std::size_t accepted_ = 0;
+};
+}
@@ -1,17 +1,20 @@
 /**
  * @file callback.hpp
  * @brief 协程回调收集器。
- * @details 允许注册一组同步或协程函数，在指定任务上下文中串行调度执行。
+ * @details 允许注册一组同步或协程函数。同步函数在触发时直接调用，协程函数提交到任务上下文中调度执行。
  */
 #pragma once
 
 #include <concepts>
+#include <cstddef>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <type_traits>
-#include <vector>
 #include <utility>
 
 #include "core/async.hpp"
+#include "core/logger.h"
 
 namespace roboctrl {
 
@@ -27,7 +30,12 @@ concept callback_fn = std::invocable<F, Args...> &&
      std::same_as<std::invoke_result_t<F, Args...>, awaitable<void>>);
 
 /**
- * @brief 管理一组协程回调的容器。
+ * @brief 管理一组回调的容器。
+ * @details 同步回调在触发时直接在调用者中执行，不经过任务队列，因此没有协程帧的分配和排队的延迟；
+ * 协程回调则在触发时通过 roboctrl::spawn 提交到任务上下文。触发时先依次执行所有同步回调，再提交协程回调。
+ *
+ * 同步回调通常在 IO 的接收循环中执行，一个回调抛出的异常会被捕获并输出日志，不会中断其他回调和接收循环。
+ * 回调中可以注册新的回调，新回调从下一次触发开始执行。
  * @tparam Args 回调参数类型
  */
 template<typename... Args>
@@ -41,8 +49,18 @@ public:
      */
     template<typename... CallArgs>
     void operator()(CallArgs&&... args) const {
-        for (auto const& fn : fns_) {
-            roboctrl::spawn(fn(std::forward<CallArgs>(args)...));
+        // 按下标遍历触发前的回调，回调中 add() 的新回调不会在这一次被调用；deque 的 push_back 不会移动已有元素
+        for (std::size_t i = 0, n = sync_fns_.size(); i < n; ++i) {
+            try {
+                sync_fns_[i](args...);
+            } catch (const std::exception& e) {
+                logger::instance().log(log_level::Warn, "callback", "callback threw an exception: {}", e.what());
+            } catch (...) {
+                logger::instance().log(log_level::Warn, "callback", "callback threw an unknown exception");
+            }
+        }
+        for (std::size_t i = 0, n = async_fns_.size(); i < n; ++i) {
+            roboctrl::spawn(async_fns_[i](args...));
         }
     }
 
@@ -54,19 +72,22 @@ public:
     void add(F&& f) {
         using result_t = std::invoke_result_t<F, Args...>;
         if constexpr (std::same_as<result_t, awaitable<void>>) {
-            fns_.push_back(std::function<awaitable<void>(Args...)>(std::forward<F>(f)));
+            async_fns_.push_back(std::function<awaitable<void>(Args...)>(std::forward<F>(f)));
         } else {
-            fns_.push_back(std::function<awaitable<void>(Args...)>(
-                [fn = std::forward<F>(f)](Args... args) mutable -> awaitable<void> {
-                    fn(args...);
-                    co_return;
-                }
-            ));
+            sync_fns_.push_back(std::function<void(Args...)>(std::forward<F>(f)));
         }
     }
 
+    /**
+     * @brief 是否没有注册任何回调。
+     */
+    inline bool empty() const {
+        return sync_fns_.empty() && async_fns_.empty();
+    }
+
 private:
-    std::vector<std::function<awaitable<void>(Args...)>> fns_;
+    std::deque<std::function<void(Args...)>> sync_fns_;
+    std::deque<std::function<awaitable<void>(Args...)>> async_fns_;
 };
 
 } // namespace roboctrl
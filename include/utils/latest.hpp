@@ -0,0 +1,131 @@
+/**
+ * @file latest.hpp
+ * @brief 只保存最新值的信箱。
+ * @details 设备在 IO 回调中写入测量值，控制循环读取。latest 用顺序锁（seqlock）实现：写者从不等待读者，
+ * 读者读到写了一半的数据时会自动重读。每次发布都会附带时间戳和递增的序号，读者可以凭序号判断数据有没有更新，
+ * 凭时间戳判断数据有多旧，而不需要再去调用 utils::now()。
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "utils/utils.hpp"
+
+namespace roboctrl::utils{
+
+/**
+ * @brief 最新值信箱。
+ * @details 只允许一个写者，读者数量不限，读写双方可以在不同的线程中。示例：
+ *
+ * ```cpp
+ * utils::latest<motor_state> state;
+ *
+ * // IO 回调中
+ * state.publish({.angle = angle, .angle_speed = speed});
+ *
+ * // 控制循环中
+ * auto sample = state.read();
+ * if(sample.seq != last_seq){
+ *     last_seq = sample.seq;
+ *     update(sample.value);
+ * }
+ * ```
+ *
+ * @tparam T 数据类型，必须可以平凡拷贝
+ */
+template<typename T>
+class latest{
+    static_assert(std::is_trivially_copyable_v<T>, "value of latest must be trivially copyable");
+
+public:
+    /**
+     * @brief 一次发布的数据。
+     */
+    struct sample{
+        T value{};                              ///< 数据
+        std::chrono::nanoseconds timestamp{0};  ///< 发布时间，程序启动后的纳秒数，见 utils::now()
+        std::uint64_t seq = 0;                  ///< 序号，从 1 开始每次发布加一，0 表示从未发布过
+    };
+
+    latest() = default;
+
+    explicit latest(const T& initial){
+        publish(initial, std::chrono::nanoseconds{0});
+        seq_.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 发布新数据。仅写者调用。
+     * @param timestamp 数据的采样时间，默认为当前时间
+     */
+    void publish(const T& value,std::chrono::nanoseconds timestamp = utils::now()){
+        payload data{value, timestamp};
+        std::array<std::uint64_t,words> buffer{};
+        std::memcpy(buffer.data(), static_cast<const void*>(&data), sizeof(data));
+
+        auto seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for(std::size_t i = 0; i < words; ++i)
+            words_[i].store(buffer[i], std::memory_order_relaxed);
+
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief 读取最新的数据，不会阻塞写者。
+     */
+    sample read() const{
+        std::array<std::uint64_t,words> buffer;
+        std::uint64_t begin, end;
+
+        do{
+            begin = seq_.load(std::memory_order_acquire);
+            for(std::size_t i = 0; i < words; ++i)
+                buffer[i] = words_[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            end = seq_.load(std::memory_order_relaxed);
+        }while((begin & 1) || begin != end);
+
+        // payload 可以平凡拷贝，但 T 可能有非平凡的构造函数，经过 void* 拷贝以免触发 -Wclass-memaccess
+        payload data;
+        std::memcpy(static_cast<void*>(&data), buffer.data(), sizeof(data));
+        return {data.value, data.timestamp, begin / 2};
+    }
+
+    /**
+     * @brief 读取最新的数据本身。
+     */
+    inline T value() const{ return read().value; }
+
+    /**
+     * @brief 当前的序号，可以用来判断数据是否更新过，比 read() 更轻。
+     */
+    inline std::uint64_t seq() const{ return seq_.load(std::memory_order_acquire) / 2; }
+
+    /**
+     * @brief 数据是否从未发布过。
+     */
+    inline bool empty() const{ return seq() == 0; }
+
+private:
+    struct payload{
+        T value;
+        std::chrono::nanoseconds timestamp;
+    };
+
+    static constexpr std::size_t words = (sizeof(payload) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+    // 数据按 64 位字保存为原子变量，读者和写者并发访问时不构成数据竞争
+    std::array<std::atomic<std::uint64_t>,words> words_{};
+    std::atomic<std::uint64_t> seq_{0};
+};
+
+}
@@ -0,0 +1,135 @@
+/**
+ * @file spsc_ring.hpp
+ * @brief 单生产者单消费者的无锁环形队列。
+ * @details 容量在编译期确定且必须是 2 的幂，元素在构造时一次性分配好，入队出队都不会分配内存。
+ * 生产者和消费者可以在不同的线程中，但同一时刻只能各有一个。
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <utility>
+
+#include "utils/concepts.hpp"
+
+namespace roboctrl::utils{
+
+/**
+ * @brief 单生产者单消费者的无锁环形队列。
+ * @details 除了按值入队出队，还可以用 prepare()/commit() 和 front()/pop() 直接在队列的槽位中读写，省去一次拷贝：
+ *
+ * ```cpp
+ * utils::spsc_ring<frame,256> ring;
+ *
+ * // 生产者
+ * if(auto slot = ring.prepare()){
+ *     slot->size = fill(slot->data);
+ *     ring.commit();
+ * }
+ *
+ * // 消费者
+ * while(auto slot = ring.front()){
+ *     handle(*slot);
+ *     ring.pop();
+ * }
+ * ```
+ *
+ * @tparam T 元素类型，需要可默认构造
+ * @tparam Capacity 容量，必须是 2 的幂
+ */
+template<typename T,std::size_t Capacity>
+class spsc_ring : public immovable_base, public not_copyable_base{
+    static_assert(std::has_single_bit(Capacity), "capacity of spsc_ring must be a power of 2");
+
+public:
+    static constexpr std::size_t capacity = Capacity;
+
+    /**
+     * @brief 获取下一个可写的槽位，队列已满时返回 nullptr。仅生产者调用。
+     */
+    inline T* prepare(){
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if(tail - head_cache_ == Capacity){
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if(tail - head_cache_ == Capacity)
+                return nullptr;
+        }
+        return &slots_[tail & mask];
+    }
+
+    /**
+     * @brief 提交 prepare() 得到的槽位，使其对消费者可见。仅生产者调用。
+     */
+    inline void commit(){
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief 入队，队列已满时返回 false。仅生产者调用。
+     */
+    template<typename U>
+    inline bool try_push(U&& value){
+        auto slot = prepare();
+        if(!slot)
+            return false;
+        *slot = std::forward<U>(value);
+        commit();
+        return true;
+    }
+
+    /**
+     * @brief 获取队首元素，队列为空时返回 nullptr。仅消费者调用。
+     */
+    inline T* front(){
+        auto head = head_.load(std::memory_order_relaxed);
+        if(head == tail_cache_){
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if(head == tail_cache_)
+                return nullptr;
+        }
+        return &slots_[head & mask];
+    }
+
+    /**
+     * @brief 弹出 front() 得到的队首元素。仅消费者调用。
+     */
+    inline void pop(){
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief 出队，队列为空时返回 false。仅消费者调用。
+     */
+    inline bool try_pop(T& value){
+        auto slot = front();
+        if(!slot)
+            return false;
+        value = std::move(*slot);
+        pop();
+        return true;
+    }
+
+    /**
+     * @brief 当前元素个数，另一端同时在操作时只是一个近似值。
+     */
+    inline std::size_t size() const{
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    inline bool empty() const{ return size() == 0; }
+
+private:
+    static constexpr std::size_t mask = Capacity - 1;
+    // 生产者和消费者各自的下标放在不同的缓存行上，避免伪共享
+    static constexpr std::size_t cache_line = 64;
+
+    alignas(cache_line) std::atomic<std::size_t> head_{0};
+    std::size_t tail_cache_ = 0;    // 消费者看到的 tail_ 的缓存
+    alignas(cache_line) std::atomic<std::size_t> tail_{0};
+    std::size_t head_cache_ = 0;    // 生产者看到的 head_ 的缓存
+    alignas(cache_line) std::array<T,Capacity> slots_{};
+};
+
+}
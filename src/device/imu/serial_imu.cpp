@@ -17,17 +17,19 @@ struct __serial_imu_pkg
 
 serial_imu::serial_imu(const info_type& info) :imu_base{100ms}, info_{info} {
     auto& serial = roboctrl::get<io::serial>(info.serial_name);
-    serial.on_data(1,[&](const __serial_imu_pkg& pkg){
-        angle_ = {
+    serial.on_data(1,[this,&serial](const __serial_imu_pkg& pkg){
+        auto state = state_.value();
+        state.angle = {
             utils::rad_format(pkg.roll * Pi_f / 180.f), 
             utils::rad_format(pkg.pitch * Pi_f / 180.f),
             utils::rad_format(pkg.yaw * Pi_f / 180.f)
         };
-        gyro_ = {
+        state.gyro = {
             pkg.roll_v * (Pi_f / 180.f) / 1000.f, 
             pkg.pitch_v * (Pi_f / 180.f) / 1000.f,
             pkg.yaw_v * (Pi_f / 180.f) / 1000.f
         };
+        state_.publish(state, serial.rx_time());
 
         tick();
     });
@@ -1,7 +1,10 @@
+#include <array>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <span>
 #include <sys/types.h>
+#include <utility>
 
 #include "device/motor/dji.h"
 #include "core/async.hpp"
@@ -25,6 +28,9 @@ struct _dji_upload_pkg {
     uint8_t unused;
 } __attribute__((packed));
 
+/// @brief 电调的电流指令帧 ID
+constexpr std::array<uint16_t,3> _dji_command_ids{0x1ff, 0x200, 0x2ff};
+
 constexpr fp32 _rpm_to_rad_s = 2.f * Pi_f / 60.f;
 constexpr fp32 _ecd_8192_to_rad  = 2.f * Pi_f / 8192.f;
 
@@ -45,10 +51,29 @@ dji_motor_group::dji_motor_group(dji_motor_group::info_type info):
     info_{info}
 {
     std::fill(motors_.begin(),motors_.end(),nullptr);
+
+    // 指令帧总是最先发送，总线繁忙时也不会被丢弃
+    auto& can = roboctrl::get<io::can>(info.can_name);
+    for(auto id : _dji_command_ids)
+        can.set_priority(id, io::tx_priority::command);
+
     log_info("Dji Motor Group created on {}",info.can_name);
     roboctrl::spawn(task());
 }
 
+dji_motor_group::~dji_motor_group(){
+    // CAN 可能已经先析构了，它的 CAN_BCM socket 关闭时内核会自己删掉周期帧
+    if(!cyclic_payloads_.empty() && roboctrl::multiton::details::multiton_impl<io::can>::contains(info_.can_name))
+        stop_cyclic();
+}
+
+void dji_motor_group::stop_cyclic(){
+    auto& can = roboctrl::get<io::can>(info_.can_name);
+    for(auto& [can_id, payload] : cyclic_payloads_)
+        can.stop_cyclic(can_id);
+    cyclic_payloads_.clear();
+}
+
 void dji_motor_group::register_motor(dji_motor* motor){
     for(auto m : motors_){
         if(m->can_pkg_id() == motor->can_pkg_id()){
@@ -84,8 +109,8 @@ std::pair<uint16_t, uint16_t> dji_motor::can_pkg_id() const {
     }
 }
 
-roboctrl::awaitable<void> dji_motor_group::send_command(uint16_t can_id_) {
-    std::array<std::byte,8> data{};
+bool dji_motor_group::build_command(uint16_t can_id_, std::array<std::byte,8>& data) {
+    data = {};
     bool flag = false;
 
     for (auto motor : motors_) {
@@ -106,17 +131,62 @@ roboctrl::awaitable<void> dji_motor_group::send_command(uint16_t can_id_) {
         }
     }
 
-    if (flag)
-        co_await roboctrl::get<io::can>(info_.can_name).send(can_id_, data);
+    return flag;
 };
 
+void dji_motor_group::update(const dji_motor& motor){
+    auto& can = roboctrl::get<io::can>(info_.can_name);
+    if(!can.bcm_enabled())
+        return;
+
+    last_update_ = utils::now();
+
+    auto can_id = motor.can_pkg_id().first;
+    std::array<std::byte,8> payload;
+    if(!build_command(can_id, payload))
+        return;
+
+    // 数据没有变化时不需要打扰内核
+    auto it = cyclic_payloads_.find(can_id);
+    if(it != cyclic_payloads_.end() && it->second == payload)
+        return;
+
+    if(can.set_cyclic(can_id, payload, info_.period))
+        cyclic_payloads_[can_id] = payload;
+}
+
 roboctrl::awaitable<void> dji_motor_group::task(){
+    if(roboctrl::get<io::can>(info_.can_name).bcm_enabled()){
+        log_info("commands are sent by CAN_BCM every {}", info_.period);
+        if(info_.watchdog == 0)
+            co_return;
+
+        auto timeout = info_.period * info_.watchdog;
+        while(true){
+            co_await wait_for(timeout);
+
+            if(!cyclic_payloads_.empty() && utils::now() - last_update_ > timeout){
+                log_warn("no motor update for {}, stopping cyclic commands", timeout);
+                stop_cyclic();
+            }
+        }
+    }
+
+    std::array<std::array<std::byte,8>,_dji_command_ids.size()> payloads{};
+    std::array<std::pair<io::can_id_type,io::byte_span>,_dji_command_ids.size()> frames{};
+
     while(true){
-        co_await send_command(0x1ff);
-        co_await send_command(0x200);
-        co_await send_command(0x2ff);
+        // 每个周期的全部指令帧一起交给 CAN，由一次 sendmmsg() 写出
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < _dji_command_ids.size(); ++i) {
+            if (build_command(_dji_command_ids[i], payloads[i]))
+                frames[count++] = {_dji_command_ids[i], payloads[i]};
+        }
+
+        if (count > 0)
+            co_await roboctrl::get<io::can>(info_.can_name).send_batch(std::span{frames.data(), count});
 
-        co_await wait_for(1ms);
+        co_await wait_for(info_.period);
     }
 }
 
@@ -126,6 +196,7 @@ dji_motor::dji_motor(dji_motor::info_type info)
     motor_base{2ms,info.radius}
 {
     auto& group = roboctrl::get(dji_motor_group::info_type::make(info.can_name));
+    group_ = &group;
     log_debug("Dji \"{}\" motor {} created on can \"{}\" with pid(p={},i={},d={},max iout={},max out={})",
         __motor_tyep_to_string(info.type_),
         info.name,
@@ -156,15 +227,21 @@ dji_motor::dji_motor(dji_motor::info_type info)
             break;
     }
 
-    can.on_data(fallback_canid,[this](const _dji_upload_pkg& pkg) -> void{
-        angle_ = _ecd_8192_to_rad * static_cast<float>(utils::make_u16(pkg.angle_h, pkg.angle_l)) ;
-        angle_speed_ = _rpm_to_rad_s * static_cast<float>(utils::make_i16(pkg.speed_h, pkg.speed_l)) * reduction_ratio_;
-        torque_ = utils::make_i16(pkg.current_h, pkg.current_l);
+    can.on_data(fallback_canid,[this,&can](const _dji_upload_pkg& pkg) -> void{
+        motor_state state{
+            .angle = _ecd_8192_to_rad * static_cast<float>(utils::make_u16(pkg.angle_h, pkg.angle_l)),
+            .angle_speed = _rpm_to_rad_s * static_cast<float>(utils::make_i16(pkg.speed_h, pkg.speed_l)) * reduction_ratio_,
+            .torque = static_cast<float>(utils::make_i16(pkg.current_h, pkg.current_l))
+        };
+        state_.publish(state, can.rx_time());
 
-        pid_.update(linear_speed());
-        current_ = pid_.state();
+        auto linear_speed = state.angle_speed * radius_;
+        pid_.update(linear_speed);
+        // 电流没有变化时也要调用 update()，它同时是 CAN_BCM 模式下的看门狗
+        current_ = static_cast<int16_t>(pid_.state());
+        group_->update(*this);
 
-        log_debug("angle:{}, speed:{}, torque:{} ,linear speed:{},target speed:{}",this->angle_,this->angle_speed_,this->torque_,linear_speed(),pid_.target());
+        log_debug("angle:{}, speed:{}, torque:{} ,linear speed:{},target speed:{}",state.angle,state.angle_speed,state.torque,linear_speed,pid_.target());
         tick();
     });
 
@@ -19,11 +19,14 @@ M9025::M9025(const info_type& info):
     pid_{info.pid_params}
 {
     roboctrl::get<io::can>(info.can_name).on_data(0x140 + info.id,[&](const details::motor_upload_pkg& pkg) -> awaitable<void>{
-        this->angle_ = _ecd_8192_to_rad * static_cast<float>(utils::make_u16(pkg.angle_h, pkg.angle_l));
-        this->angle_speed_ = _rpm_to_rad_s * static_cast<float>(utils::make_i16(pkg.speed_h, pkg.speed_l));
-        this->torque_ = utils::make_i16(pkg.current_h, pkg.speed_l);
+        motor_state state{
+            .angle = _ecd_8192_to_rad * static_cast<float>(utils::make_u16(pkg.angle_h, pkg.angle_l)),
+            .angle_speed = _rpm_to_rad_s * static_cast<float>(utils::make_i16(pkg.speed_h, pkg.speed_l)),
+            .torque = static_cast<float>(utils::make_i16(pkg.current_h, pkg.speed_l))
+        };
+        this->state_.publish(state);
 
-        this->pid_.update(this->angle_speed_);
+        this->pid_.update(state.angle_speed);
 
         std::array<std::byte,8> data;
 
@@ -31,7 +34,7 @@ M9025::M9025(const info_type& info):
 
         co_await roboctrl::get<io::can>(info_.can_name).send(0x200 + info_.id,data);
 
-        this->log_debug("angle:{}, speed:{}, torque:{}",this->angle_,this->angle_speed_,this->torque_);
+        this->log_debug("angle:{}, speed:{}, torque:{}",state.angle,state.angle_speed,state.torque);
         this->tick();
     });
     
@@ -41,7 +44,7 @@ M9025::M9025(const info_type& info):
 roboctrl::awaitable<void> M9025::set(fp32 speed)
 {
     pid_.set_target(speed);
-    pid_.update(this->angle_speed_);
+    pid_.update(angle_speed());
 
     co_return;
 }
\ No newline at end of file
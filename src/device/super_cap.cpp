@@ -16,11 +16,14 @@ struct __super_cap_recive_pkg
 bool super_cap::init(const super_cap::info_type& info){
     info_ = info;
 
-    roboctrl::get<roboctrl::io::can>(info.can_name).on_data(0x51,[&](const __super_cap_recive_pkg& pkg){
-        chassis_power_ = pkg.chassisPower;
-        chassis_power_limit_ = pkg.chassisPowerlimit;
-        energy_ = pkg.capEnergy;
-        log_info("error code : {},chassis_power: {}, chassis_power_limit: {}, energy: {}",pkg.errorCode,chassis_power_,chassis_power_limit_,energy_);
+    auto& can = roboctrl::get<roboctrl::io::can>(info.can_name);
+    can.on_data(0x51,[this,&can](const __super_cap_recive_pkg& pkg){
+        state_.publish({
+            .chassis_power = pkg.chassisPower,
+            .chassis_power_limit = pkg.chassisPowerlimit,
+            .energy = pkg.capEnergy
+        }, can.rx_time());
+        log_info("error code : {},chassis_power: {}, chassis_power_limit: {}, energy: {}",pkg.errorCode,pkg.chassisPower,pkg.chassisPowerlimit,pkg.capEnergy);
     });
 
     return true;
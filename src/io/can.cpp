@@ -3,17 +3,72 @@
 #include "core/async.hpp"
 #include "io/base.hpp"
 #include "linux/can.h"
+#include "linux/can/bcm.h"
+#include "linux/can/raw.h"
 #include "utils/utils.hpp"
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
-#include <cstdlib>
+#include <cerrno>
+#include <cstring>
 #include <stdexcept>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <optional>
 #include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
 
 using namespace roboctrl::io;
 
+static constexpr std::size_t __rx_control_size = CMSG_SPACE(sizeof(::scm_timestamping));
+
+static std::chrono::nanoseconds __realtime_now(){
+    ::timespec ts{};
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return std::chrono::seconds{ts.tv_sec} + std::chrono::nanoseconds{ts.tv_nsec};
+}
+
+/**
+ * 从控制消息中取出 SO_TIMESTAMPING 的软件接收时间戳（CLOCK_REALTIME）。
+ * ts[2] 是控制器自己的硬件时钟，与 CLOCK_REALTIME 无关，不能直接换算，这里不使用。
+ */
+static std::optional<std::chrono::nanoseconds> __rx_timestamp(::msghdr& hdr){
+    for(auto cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)){
+        if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPING)
+            continue;
+
+        ::scm_timestamping tss;
+        std::memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+
+        const auto& ts = tss.ts[0];
+        if(ts.tv_sec != 0 || ts.tv_nsec != 0)
+            return std::chrono::seconds{ts.tv_sec} + std::chrono::nanoseconds{ts.tv_nsec};
+    }
+
+    return std::nullopt;
+}
+
+/// @brief 发送队列中 CAN FD 帧的标志，和 CANFD_BRS 等内核标志一起保存在 tx_queue::entry::flags 中
+static constexpr std::uint8_t __fd_frame = 0x80;
+
+/**
+ * CAN FD 帧的长度只能取 0~8、12、16、20、24、32、48、64，返回能装下 size 字节的最小长度。
+ */
+static std::size_t __fd_frame_len(std::size_t size){
+    constexpr std::array<std::size_t,7> lens{12, 16, 20, 24, 32, 48, 64};
+    if(size <= CAN_MAX_DLEN)
+        return size;
+    for(auto len : lens)
+        if(size <= len)
+            return len;
+    return CANFD_MAX_DLEN;
+}
+
 template <>
-struct std::formatter<can_frame> : std::formatter<std::string> {
-    auto format(const can_frame& frame, std::format_context& ctx) const {
+struct std::formatter<canfd_frame> : std::formatter<std::string> {
+    auto format(const canfd_frame& frame, std::format_context& ctx) const {
         std::ostringstream oss;
         oss << std::hex << std::uppercase;
         oss << "CAN ID=0x" << (frame.can_id & CAN_EFF_MASK);
@@ -22,14 +77,15 @@ struct std::formatter<can_frame> : std::formatter<std::string> {
         if (frame.can_id & CAN_EFF_FLAG) oss << "EFF ";
         if (frame.can_id & CAN_RTR_FLAG) oss << "RTR ";
         if (frame.can_id & CAN_ERR_FLAG) oss << "ERR ";
+        if (frame.flags & CANFD_BRS) oss << "BRS ";
         oss << "]";
 
-        oss << " DLC=" << std::dec << static_cast<int>(frame.can_dlc)
+        oss << " LEN=" << std::dec << static_cast<int>(frame.len)
             << " DATA=[";
 
-        for (int i = 0; i < frame.can_dlc; ++i) {
+        for (int i = 0; i < frame.len; ++i) {
             oss << std::format("{:02X}", frame.data[i]);
-            if (i + 1 < frame.can_dlc) oss << ' ';
+            if (i + 1 < frame.len) oss << ' ';
         }
         oss << ']';
 
@@ -41,7 +97,9 @@ can::can(const can::info_type& info)
     :info_{info},
     keyed_io_base{},
     stream_{roboctrl::io_context()},
-    can_name_{info.can_name.data(),info.can_name.length()}
+    bcm_{roboctrl::io_context()},
+    can_name_{info.can_name.data(),info.can_name.length()},
+    tx_{info.tx}
 {
     int fd = ::socket(PF_CAN,SOCK_RAW,CAN_RAW);
     if(fd < 0)
@@ -60,53 +118,379 @@ can::can(const can::info_type& info)
 
     stream_.assign(fd);
 
-    cf_ = (::can_frame*)std::malloc(sizeof(::can_frame) + 8);
+    if(info.bcm){
+        int bcm_fd = ::socket(PF_CAN, SOCK_DGRAM, CAN_BCM);
+        if(bcm_fd < 0)
+            throw std::runtime_error("socket(CAN_BCM) failed");
+
+        if(::connect(bcm_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0){
+            ::close(bcm_fd);
+            throw std::runtime_error("connect(CAN_BCM) failed");
+        }
+
+        bcm_.assign(bcm_fd);
+    }
+
+    if(info.fd){
+        int enable = 1;
+        if(::setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable)) < 0)
+            throw std::runtime_error("setsockopt(CAN_RAW_FD_FRAMES) failed, does the interface support CAN FD?");
+    }
+
+    if(info.rx_timestamp){
+        int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        if(::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0)
+            log_warn("SO_TIMESTAMPING not supported, using callback time as rx time");
+    }
+
+    if(info.error_frames){
+        ::can_err_mask_t err_mask = CAN_ERR_MASK;
+        if(::setsockopt(fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask)) < 0)
+            log_warn("failed to subscribe to error frames: {}", std::strerror(errno));
+    }
+
+    // 注册回调时不立即安装过滤器，而是合并同一轮中的所有注册，之后统一安装一次
+    if(info.rx_filter){
+        set_register_hook([this](can_id_type){
+            if(filters_dirty_)
+                return;
+            filters_dirty_ = true;
+            roboctrl::post([this]{ install_filters(); });
+        });
+    }
+
+    auto rx_batch = std::max<std::size_t>(info.rx_batch, 1);
+    rx_frames_.resize(rx_batch);
+    rx_iovs_.resize(rx_batch);
+    rx_msgs_.resize(rx_batch);
+    rx_control_.resize(rx_batch * __rx_control_size);
+    rx_times_.resize(rx_batch);
+
+    for(std::size_t i = 0; i < rx_batch; ++i){
+        rx_iovs_[i] = {.iov_base = &rx_frames_[i], .iov_len = info.fd ? CANFD_MTU : CAN_MTU};
+        rx_msgs_[i].msg_hdr.msg_iov = &rx_iovs_[i];
+        rx_msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    tx_frames_.resize(tx_.capacity());
+    tx_iovs_.resize(tx_.capacity());
+    tx_msgs_.resize(tx_.capacity());
 
     log_info("Can io created on {}",info.can_name);
     
-    roboctrl::spawn(task());
-}
+    if(info.rx_thread.enabled){
+        rx_thread_.start(info.can_name, info.rx_thread, fd,
+            [this](auto& rx){
+                int n = receive();
+                for(int i = 0; i < n; ++i){
+                    if(auto slot = rx.prepare()){
+                        *slot = {rx_frames_[i], rx_msgs_[i].msg_len, rx_times_[i], static_cast<bool>(rx_msgs_[i].msg_hdr.msg_flags & MSG_DONTROUTE)};
+                        rx.commit();
+                    }
+                }
+            },
+            [this](rx_frame& frame){
+                record_rx_drop(rx_thread_.take_overruns());
+                handle(frame.frame, frame.mtu, frame.time, frame.local);
+            });
+    }
+    else
+        roboctrl::spawn(task());
 
-can::~can(){
-    std::free(cf_);
+    roboctrl::spawn(tx_.run([this](auto batch){ return write(batch); }));
 }
 
 roboctrl::awaitable<void> can::task(){
     while(true){
-        size_t pkg_size = co_await stream_.async_read_some(asio::buffer(buffer_),asio::use_awaitable);
-        can_frame cf = utils::from_bytes<can_frame>(std::span{buffer_.data(),pkg_size});
+        co_await stream_.async_wait(asio::posix::stream_descriptor::wait_read, asio::use_awaitable);
+
+        int n = receive();
+        for(int i = 0; i < n; ++i)
+            handle(rx_frames_[i], rx_msgs_[i].msg_len, rx_times_[i], rx_msgs_[i].msg_hdr.msg_flags & MSG_DONTROUTE);
+    }
+}
+
+int can::receive(){
+    // 内核会改写 msg_controllen，每次读取前都要重置
+    for(std::size_t i = 0; i < rx_msgs_.size(); ++i){
+        auto& hdr = rx_msgs_[i].msg_hdr;
+        hdr.msg_control = rx_control_.data() + i * __rx_control_size;
+        hdr.msg_controllen = __rx_control_size;
+        hdr.msg_flags = 0;
+    }
 
-        can_id_type id = cf.can_id;
-        size_t can_size= cf.can_dlc;
+    int n = ::recvmmsg(stream_.native_handle(), rx_msgs_.data(), rx_msgs_.size(), MSG_DONTWAIT, nullptr);
+    if(n < 0){
+        if(errno != EAGAIN && errno != EWOULDBLOCK)
+            log_warn("failed to receive can frames: {}", std::strerror(errno));
+        return 0;
+    }
 
-        //log_debug("recv can frame: {}",cf);
+    auto now = utils::now();
+    auto realtime_offset = now - __realtime_now();
 
-        dispatch(id,std::span{(std::byte*)cf.data,can_size});
+    for(int i = 0; i < n; ++i){
+        auto kernel_time = __rx_timestamp(rx_msgs_[i].msg_hdr);
+        rx_times_[i] = kernel_time ? *kernel_time + realtime_offset : now;
     }
+
+    return n;
 }
 
-roboctrl::awaitable<void> can::send(byte_span frame){
-    co_await stream_.async_write_some(
-        asio::buffer(frame.data(), frame.size()),
-        asio::use_awaitable
-    );
+void can::handle(const ::canfd_frame& cf, std::size_t mtu, std::chrono::nanoseconds rx_time, bool local){
+    std::size_t max_len;
+    if(mtu == CANFD_MTU)
+        max_len = CANFD_MAX_DLEN;
+    else if(mtu == CAN_MTU)
+        max_len = CAN_MAX_DLEN;
+    else{
+        record_parse_failure();
+        return;
+    }
+
+    // 错误帧总是经典帧，canfd_frame 的前 CAN_MTU 个字节与 can_frame 布局相同
+    if(cf.can_id & CAN_ERR_FLAG){
+        log_warn("error frame: {}", cf);
+        dispatch(error_frame_key, byte_span{(std::byte*)&cf, CAN_MTU}, rx_time);
+        return;
+    }
+
+    //log_debug("recv can frame: {}",cf);
+
+    // CAN_BCM 发出的周期帧会回环到这个 socket（关闭 rx_filter 时），load() 已经按周期计入了它们
+    if(!(local && cyclic_.contains(cf.can_id)))
+        record_load(cf.can_id, cf.len, max_len == CANFD_MAX_DLEN, cf.flags & CANFD_BRS);
+
+    dispatch(cf.can_id, byte_span{(std::byte*)cf.data, std::min<std::size_t>(cf.len, max_len)}, rx_time);
+}
+
+void can::install_filters(){
+    filters_dirty_ = false;
+
+    std::vector<::can_filter> filters;
+    for_each_registered_key([&](can_id_type id){
+        if(id == error_frame_key)
+            return;
+
+        if(id & CAN_EFF_FLAG)
+            filters.push_back({.can_id = id, .can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_EFF_MASK});
+        else
+            filters.push_back({.can_id = id, .can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_SFF_MASK});
+    });
+
+    if(filters.size() > CAN_RAW_FILTER_MAX){
+        log_warn("{} ids registered, more than the kernel filter limit, receiving all frames", filters.size());
+        filters = {{.can_id = 0, .can_mask = 0}};
+    }
+
+    if(::setsockopt(stream_.native_handle(), SOL_CAN_RAW, CAN_RAW_FILTER,
+            filters.data(), filters.size() * sizeof(::can_filter)) < 0){
+        log_warn("failed to install can filters: {}", std::strerror(errno));
+        return;
+    }
+
+    log_debug("installed {} can filters", filters.size());
+}
+
+bool can::set_cyclic(can_id_type id, byte_span data, std::chrono::microseconds period){
+    if(!info_.bcm)
+        throw std::logic_error(std::format("{} is not opened with CAN_BCM", desc()));
+
+    if(data.size() > CAN_MAX_DLEN)
+        throw std::invalid_argument("payload of cyclic can frame can't > 8");
+
+    ::bcm_msg_head head{};
+    head.opcode = TX_SETUP;
+    head.can_id = id;
+    head.nframes = 1;
+
+    ::can_frame frame{};
+    frame.can_id = id;
+    frame.can_dlc = data.size();
+    std::memcpy(frame.data, data.data(), data.size());
+
+    // 只有新的 ID 或者周期变化时才重新设置定时器，否则只更新数据，不打乱发送节奏
+    auto it = cyclic_.find(id);
+    if(it == cyclic_.end() || it->second.period != period){
+        auto us = period.count();
+        head.flags = SETTIMER | STARTTIMER;
+        head.ival2.tv_sec = us / 1000000;
+        head.ival2.tv_usec = us % 1000000;
+    }
+
+    // CAN_BCM 的消息是消息头后面紧跟 nframes 个帧
+    alignas(::bcm_msg_head) std::array<std::byte, sizeof(::bcm_msg_head) + sizeof(::can_frame)> msg;
+    std::memcpy(msg.data(), &head, sizeof(head));
+    std::memcpy(msg.data() + sizeof(head), &frame, sizeof(frame));
+
+    if(::write(bcm_.native_handle(), msg.data(), msg.size()) < 0){
+        record_send_error();
+        log_warn("failed to set cyclic can frame {:#x}: {}", id, std::strerror(errno));
+        return false;
+    }
+
+    cyclic_[id] = {period, can_frame_time(data.size(), id & CAN_EFF_FLAG, false, false, info_.bitrate)};
+    return true;
+}
+
+bool can::stop_cyclic(can_id_type id){
+    if(!info_.bcm || !cyclic_.contains(id))
+        return false;
+
+    ::bcm_msg_head head{};
+    head.opcode = TX_DELETE;
+    head.can_id = id;
+
+    cyclic_.erase(id);
+    if(::write(bcm_.native_handle(), &head, sizeof(head)) < 0){
+        log_warn("failed to stop cyclic can frame {:#x}: {}", id, std::strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+double can::load(){
+    auto load = load_.utilization(utils::now());
+
+    // 周期帧由内核发送，不经过这个 socket，按周期折算成负载
+    for(auto& [id, frame] : cyclic_){
+        if(frame.period.count() > 0)
+            load += static_cast<double>(frame.frame_time.count()) / std::chrono::nanoseconds{frame.period}.count();
+    }
+
+    return load;
+}
+
+void can::record_load(can_id_type id, std::size_t size, bool fd, bool brs){
+    load_.record(can_frame_time(size, id & CAN_EFF_FLAG, fd, brs, info_.bitrate, info_.data_bitrate), utils::now());
 }
 
+void can::enqueue(can_id_type id, byte_span data, std::uint8_t flags){
+    auto priority = this->priority(id);
+
+    // 负载在两次写入之间也会变化，例如周期帧刚刚启动，丢弃遥测帧前重新计算
+    if(priority == tx_priority::telemetry && update_overload()){
+        record_tx_drop();
+        return;
+    }
+
+    if(tx_.push(id, data, flags, priority))
+        record_tx_drop();
+}
+
+std::uint8_t can::frame_flags(std::size_t size, bool fd, bool brs) const{
+    if(size > (info_.fd ? CANFD_MAX_DLEN : CAN_MAX_DLEN))
+        throw std::invalid_argument(std::format("payload of {} bytes is too long for {}", size, desc()));
+
+    if(!fd && size <= CAN_MAX_DLEN)
+        return 0;
+
+    if(!info_.fd)
+        throw std::invalid_argument(std::format("{} is not in CAN FD mode", desc()));
+
+    return __fd_frame | (brs ? CANFD_BRS : 0);
+}
+
+roboctrl::awaitable<void> can::send(byte_span frame){
+    if(frame.size() == CANFD_MTU){
+        auto cf = utils::from_bytes<::canfd_frame>(frame);
+        auto data = byte_span{(std::byte*)cf.data, std::min<std::size_t>(cf.len, CANFD_MAX_DLEN)};
+        co_await send_fd(cf.can_id, data, cf.flags & CANFD_BRS);
+        co_return;
+    }
+
+    if(frame.size() != CAN_MTU)
+        throw std::invalid_argument("raw can frame must be a can_frame or canfd_frame");
+
+    auto cf = utils::from_bytes<::can_frame>(frame);
+    co_await send(cf.can_id, byte_span{(std::byte*)cf.data, std::min<std::size_t>(cf.can_dlc, CAN_MAX_DLEN)});
+}
 
 roboctrl::awaitable<void> can::send(can_id_type id, byte_span data) {
+    enqueue(id, data, frame_flags(data.size(), false, info_.brs));
+    co_return;
+}
+
+roboctrl::awaitable<void> can::send_fd(can_id_type id, byte_span data, bool brs) {
+    enqueue(id, data, frame_flags(data.size(), true, brs));
+    co_return;
+}
+
+roboctrl::awaitable<void> can::send_batch(std::span<const std::pair<can_id_type,byte_span>> frames){
+    for(auto& [id, data] : frames)
+        frame_flags(data.size(), false, info_.brs);
+
+    for(auto& [id, data] : frames)
+        enqueue(id, data, frame_flags(data.size(), false, info_.brs));
 
-    if (data.size() > 8) {
-        throw std::invalid_argument("payload of can can't > 8");
+    co_return;
+}
+
+roboctrl::awaitable<void> can::write(std::span<tx_queue<can_id_type>::entry> batch){
+    for(std::size_t i = 0; i < batch.size(); ++i){
+        auto& entry = batch[i];
+        bool fd_frame = entry.flags & __fd_frame;
+
+        // 填充字节保持为 0
+        auto& cf = tx_frames_[i];
+        cf = {};
+        cf.can_id = entry.key;
+        cf.len = fd_frame ? __fd_frame_len(entry.data.size()) : entry.data.size();
+        cf.flags = fd_frame ? (entry.flags & ~__fd_frame) : 0;
+        std::memcpy(cf.data, entry.data.data(), entry.data.size());
+
+        log_debug("send can frame: {}", cf);
+
+        tx_iovs_[i] = {.iov_base = &cf, .iov_len = fd_frame ? CANFD_MTU : CAN_MTU};
+        tx_msgs_[i] = {};
+        tx_msgs_[i].msg_hdr.msg_iov = &tx_iovs_[i];
+        tx_msgs_[i].msg_hdr.msg_iovlen = 1;
     }
 
-    cf_->can_id = id;
-    cf_->can_dlc = data.size();
-    std::memcpy(cf_->data, data.data(), data.size());
+    // 一次 sendmmsg() 写出整批帧，内核发送队列满时等待可写后继续发送剩下的帧
+    std::size_t sent = 0;
+    while(sent < batch.size()){
+        int n = ::sendmmsg(stream_.native_handle(), tx_msgs_.data() + sent, batch.size() - sent, MSG_DONTWAIT);
+
+        if(n < 0){
+            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS){
+                try{
+                    co_await stream_.async_wait(asio::posix::stream_descriptor::wait_write, asio::use_awaitable);
+                    continue;
+                }
+                catch(const std::exception& e){
+                    log_warn("failed to wait for can socket: {}", e.what());
+                }
+            }
+            else
+                log_warn("failed to send can frame: {}", std::strerror(errno));
 
-    log_debug("send can frame: {}", *cf_);
+            // 跳过发送失败的这一帧
+            record_send_error();
+            ++sent;
+            continue;
+        }
 
-    co_await stream_.async_write_some(
-        asio::buffer(cf_, sizeof(can_frame)),
-        asio::use_awaitable
-    );
+        for(std::size_t i = sent; i < sent + n; ++i){
+            record_tx(batch[i].key, batch[i].data.size());
+            record_load(batch[i].key, tx_frames_[i].len, batch[i].flags & __fd_frame, batch[i].flags & CANFD_BRS);
+        }
+        sent += n;
+    }
+
+    update_overload();
+}
+
+bool can::update_overload(){
+    // 负载越过阈值时提醒一次，而不是每一批都刷屏
+    bool overloaded = load() > info_.shed_threshold;
+    if(overloaded != overloaded_){
+        overloaded_ = overloaded;
+        if(overloaded)
+            log_warn("bus load above {:.0f}%, dropping telemetry frames", info_.shed_threshold * 100);
+        else
+            log_info("bus load back below {:.0f}%", info_.shed_threshold * 100);
+    }
+    return overloaded_;
 }
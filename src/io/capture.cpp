@@ -0,0 +1,124 @@
+#include "io/capture.h"
+#include "core/multiton.hpp"
+#include "io/base.hpp"
+#include "io/can.h"
+#include "io/serial.h"
+#include "io/shm.h"
+#include "io/tcp.h"
+#include "io/udp.h"
+#include "utils/utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace roboctrl::io;
+
+capture::~capture(){
+    if(map_){
+        ::msync(map_, size_, MS_SYNC);
+        ::munmap(map_, capacity_);
+    }
+
+    if(fd_ >= 0){
+        if(::ftruncate(fd_, static_cast<off_t>(size_)) < 0)
+            log_warn("failed to truncate capture file");
+        ::close(fd_);
+    }
+}
+
+bool capture::init(const info_type& info){
+    info_ = info;
+
+    fd_ = ::open(info_.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd_ < 0){
+        log_error("failed to open capture file: {}", std::strerror(errno));
+        return false;
+    }
+
+    size_ = sizeof(capture_file_header);
+    if(!reserve(std::max(info_.capacity, size_)))
+        return false;
+
+    capture_file_header header{.magic = capture_file_header::magic_value, .size = size_};
+    std::memcpy(map_, &header, sizeof(header));
+
+    attach<can>(io_kind::can);
+    attach<serial>(io_kind::serial);
+    attach<udp>(io_kind::udp);
+    attach<tcp>(io_kind::tcp);
+    attach<shm>(io_kind::shm);
+
+    log_info("Capture started");
+    return true;
+}
+
+template<typename T>
+void capture::attach(io_kind kind){
+    for(auto& [key, io] : roboctrl::instances<T>()){
+        io->set_tap([this, kind, name = key](std::span<const std::byte> k, std::span<const std::byte> data, std::chrono::nanoseconds time){
+            record(kind, name, k, data, time);
+        });
+        log_info("Capturing {}", io->desc());
+    }
+}
+
+bool capture::reserve(std::size_t size){
+    if(size <= capacity_)
+        return true;
+
+    auto capacity = std::max(size, capacity_ * 2);
+    if(::ftruncate(fd_, static_cast<off_t>(capacity)) < 0){
+        log_error("failed to grow capture file: {}", std::strerror(errno));
+        return false;
+    }
+
+    void* map = map_
+        ? ::mremap(map_, capacity_, capacity, MREMAP_MAYMOVE)
+        : ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+
+    if(map == MAP_FAILED){
+        log_error("failed to map capture file: {}", std::strerror(errno));
+        return false;
+    }
+
+    map_ = static_cast<std::byte*>(map);
+    capacity_ = capacity;
+    return true;
+}
+
+void capture::record(io_kind kind,std::string_view name,std::span<const std::byte> key,std::span<const std::byte> data,std::chrono::nanoseconds timestamp){
+    if(!map_)
+        return;
+
+    name = name.substr(0, 0xff);
+
+    capture_record_header header{
+        .timestamp = static_cast<std::uint64_t>(timestamp.count()),
+        .kind = kind,
+        .name_size = static_cast<std::uint8_t>(name.size()),
+        .key_size = static_cast<std::uint8_t>(key.size()),
+        .reserved = 0,
+        .data_size = static_cast<std::uint32_t>(data.size())
+    };
+
+    auto total = sizeof(header) + name.size() + key.size() + data.size();
+    // 扩容失败时丢弃这一条记录，原来的映射和已经写入的数据仍然有效
+    if(!reserve(size_ + total))
+        return;
+
+    auto p = map_ + size_;
+    std::memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    std::memcpy(p, name.data(), name.size());
+    p += name.size();
+    std::memcpy(p, key.data(), key.size());
+    p += key.size();
+    std::memcpy(p, data.data(), data.size());
+
+    size_ += total;
+    ++records_;
+    std::memcpy(map_ + offsetof(capture_file_header, size), &size_, sizeof(std::uint64_t));
+}
@@ -0,0 +1,76 @@
+#include "io/frame_pool.h"
+
+#include <cstddef>
+#include <new>
+
+using namespace roboctrl::io;
+
+static details::frame_block* __allocate_block(std::size_t capacity, std::uint32_t size_class){
+    void* mem = ::operator new(sizeof(details::frame_block) + capacity);
+    auto block = static_cast<details::frame_block*>(mem);
+    block->next = nullptr;
+    block->pool = nullptr;
+    block->refs = 0;
+    block->size = 0;
+    block->capacity = static_cast<std::uint32_t>(capacity);
+    block->size_class = size_class;
+    return block;
+}
+
+frame_pool& frame_pool::local(){
+    thread_local frame_pool pool;
+    return pool;
+}
+
+frame_pool::~frame_pool(){
+    for(auto& head : free_){
+        while(head){
+            auto next = head->next;
+            ::operator delete(head);
+            head = next;
+        }
+    }
+}
+
+frame_buffer frame_pool::acquire(std::size_t size){
+    std::uint32_t cls = 0;
+    while(cls < block_sizes.size() && block_sizes[cls] < size)
+        ++cls;
+
+    details::frame_block* block;
+
+    if(cls == block_sizes.size()){
+        ++stats_.misses;
+        ++stats_.oversize;
+        block = __allocate_block(size, cls);
+    }
+    else if(free_[cls]){
+        ++stats_.hits;
+        block = free_[cls];
+        free_[cls] = block->next;
+    }
+    else{
+        ++stats_.misses;
+        ++stats_.blocks;
+        block = __allocate_block(block_sizes[cls], cls);
+    }
+
+    ++stats_.in_use;
+    block->next = nullptr;
+    block->pool = this;
+    block->refs = 1;
+    block->size = static_cast<std::uint32_t>(size);
+    return frame_buffer{block};
+}
+
+void frame_pool::release(details::frame_block* block) noexcept {
+    --stats_.in_use;
+
+    if(block->size_class >= block_sizes.size()){
+        ::operator delete(block);
+        return;
+    }
+
+    block->next = free_[block->size_class];
+    free_[block->size_class] = block;
+}
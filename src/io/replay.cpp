@@ -0,0 +1,148 @@
+#include "io/capture.h"
+#include "core/async.hpp"
+#include "core/multiton.hpp"
+#include "io/base.hpp"
+#include "io/can.h"
+#include "io/serial.h"
+#include "io/shm.h"
+#include "io/tcp.h"
+#include "io/udp.h"
+#include "utils/utils.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace roboctrl::io;
+
+replay::~replay(){
+    if(map_)
+        ::munmap(map_, size_);
+}
+
+bool replay::init(const info_type& info){
+    info_ = info;
+
+    int fd = ::open(info_.path.c_str(), O_RDONLY);
+    if(fd < 0){
+        log_error("failed to open capture file: {}", std::strerror(errno));
+        return false;
+    }
+
+    struct stat st{};
+    ::fstat(fd, &st);
+    size_ = static_cast<std::size_t>(st.st_size);
+
+    // 使用私有映射，回调即使修改了数据也不会写回文件
+    void* map = size_ >= sizeof(capture_file_header)
+        ? ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+        : MAP_FAILED;
+    ::close(fd);
+
+    if(map == MAP_FAILED){
+        log_error("failed to map capture file");
+        return false;
+    }
+
+    map_ = static_cast<std::byte*>(map);
+
+    auto header = utils::from_bytes<capture_file_header>(std::span{map_, sizeof(capture_file_header)});
+    if(header.magic != capture_file_header::magic_value){
+        log_error("{} is not a capture file", info_.path);
+        return false;
+    }
+
+    size_ = std::min<std::size_t>(size_, header.size);
+
+    log_info("Replay {} bytes", size_);
+    roboctrl::spawn(task());
+    return true;
+}
+
+template<typename T>
+bool replay::dispatch_to(std::string_view name,std::span<std::byte> key,std::span<std::byte> data,std::chrono::nanoseconds rx_time){
+    using owner = roboctrl::multiton::details::multiton_impl<T>;
+    if(!owner::contains(name))
+        return false;
+
+    auto& io = roboctrl::get<T>(name);
+
+    if constexpr (keyed_io<T>){
+        using key_type = typename T::key_type;
+        if(key.size() != sizeof(key_type))
+            return false;
+        io.dispatch(roboctrl::utils::from_bytes<key_type>(key), data, rx_time);
+    }
+    else
+        io.dispatch(data, rx_time);
+
+    return true;
+}
+
+void replay::dispatch(const capture_record_header& header,std::string_view name,std::span<std::byte> key,std::span<std::byte> data,std::chrono::nanoseconds rx_time){
+    bool ok = false;
+
+    switch(header.kind){
+        case io_kind::can:
+            ok = dispatch_to<can>(name, key, data, rx_time);
+            break;
+        case io_kind::serial:
+            ok = dispatch_to<serial>(name, key, data, rx_time);
+            break;
+        case io_kind::udp:
+            ok = dispatch_to<udp>(name, key, data, rx_time);
+            break;
+        case io_kind::tcp:
+            ok = dispatch_to<tcp>(name, key, data, rx_time);
+            break;
+        case io_kind::shm:
+            ok = dispatch_to<shm>(name, key, data, rx_time);
+            break;
+    }
+
+    if(ok)
+        ++records_;
+    else if(skipped_++ == 0)
+        log_warn("no io named {} to replay to, skipping", name);
+}
+
+roboctrl::awaitable<void> replay::task(){
+    do{
+        std::size_t pos = sizeof(capture_file_header);
+        auto start = utils::now();
+        std::optional<std::uint64_t> first;
+
+        while(pos + sizeof(capture_record_header) <= size_){
+            auto header = utils::from_bytes<capture_record_header>(std::span{map_ + pos, sizeof(capture_record_header)});
+            auto total = sizeof(header) + header.name_size + header.key_size + header.data_size;
+            if(pos + total > size_)
+                break;
+
+            auto p = map_ + pos + sizeof(header);
+            std::string_view name{reinterpret_cast<const char*>(p), header.name_size};
+            std::span<std::byte> key{p + header.name_size, header.key_size};
+            std::span<std::byte> data{p + header.name_size + header.key_size, header.data_size};
+            pos += total;
+
+            if(!first)
+                first = std::uint64_t{header.timestamp};
+
+            auto due = start + std::chrono::nanoseconds{static_cast<std::int64_t>(header.timestamp - *first)};
+            if(info_.realtime){
+                auto now = utils::now();
+                if(due > now)
+                    co_await roboctrl::wait_for(due - now);
+            }
+            else if(records_ % 64 == 0)
+                co_await roboctrl::yield();
+
+            dispatch(header, name, key, data, due);
+        }
+
+        log_info("Replay finished, {} records replayed, {} skipped", records_, skipped_);
+    }while(info_.loop);
+}
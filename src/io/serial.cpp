@@ -1,57 +1,186 @@
 #include "io/serial.h"
-#include "asio/completion_condition.hpp"
-#include "asio/read.hpp"
 #include "core/async.hpp"
 #include "io/base.hpp"
+#include "io/serial_termios.h"
 #include "utils/utils.hpp"
 
+#include <cerrno>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <unistd.h>
 
 using namespace roboctrl::io;
 
 serial::serial(info_type info)
     : keyed_io_base<uint8_t>{},
       port_{roboctrl::io_context()},
-      info_{info}
+      info_{info},
+      tx_{info.tx},
+      rx_parser_{make_rx_parser()}
 {
     port_.open(std::string(info.device));
-    port_.set_option(asio::serial_port_base::baud_rate(info.baud_rate));
+    int fd = port_.native_handle();
+
+    if(info.latency.exclusive && !details::set_exclusive(fd))
+        throw std::runtime_error(std::format("failed to lock {}: {}", info.device, std::strerror(errno)));
+
     port_.set_option(asio::serial_port_base::character_size(8));
     port_.set_option(asio::serial_port_base::parity(asio::serial_port_base::parity::none));
     port_.set_option(asio::serial_port_base::stop_bits(asio::serial_port_base::stop_bits::one));
     port_.set_option(asio::serial_port_base::flow_control(asio::serial_port_base::flow_control::none));
 
-    roboctrl::spawn(task());
+    // asio 只认识标准波特率，其他的通过 termios2 设置
+    asio::error_code ec;
+    port_.set_option(asio::serial_port_base::baud_rate(info.baud_rate), ec);
+    if(ec && !details::set_custom_baud_rate(fd, info.baud_rate))
+        throw std::runtime_error(std::format("failed to set baud rate {} on {}: {}", info.baud_rate, info.device, std::strerror(errno)));
+
+    if(!details::set_read_timing(fd, info.latency.vmin, info.latency.vtime))
+        log_warn("failed to set VMIN/VTIME: {}", std::strerror(errno));
+
+    if(info.latency.low_latency && !details::set_low_latency(fd))
+        log_warn("ASYNC_LOW_LATENCY not supported by the driver: {}", std::strerror(errno));
+
+    tx_buffer_.reserve(tx_.capacity() * 64);
+
+    set_register_hook([this](key_type key){
+        rx_sizes_[key].store(static_cast<std::uint16_t>(package_size(key)), std::memory_order_relaxed);
+    });
+
+    if(info.rx_thread.enabled){
+        rx_thread_.start(info.name, info.rx_thread, port_.native_handle(),
+            [this](auto& rx){ receive(rx); },
+            [this](rx_frame& frame){
+                record_rx_drop(rx_thread_.take_overruns());
+                if(rx_failures_.load(std::memory_order_relaxed))
+                    record_parse_failure(rx_failures_.exchange(0, std::memory_order_relaxed));
+                dispatch(frame.key, byte_span{frame.data.data(), frame.size}, frame.time);
+            });
+    }
+    else
+        roboctrl::spawn(task());
+    roboctrl::spawn(tx_.run([this](auto batch){ return write(batch); }));
+}
+
+serial::rx_parser serial::make_rx_parser()
+{
+    key_data key{.sizes_ = &rx_sizes_};
+    auto parser = info_.crc
+        ? rx_parser{std::in_place_index<1>, rx_header{}, key, other_all{}, checksum_data<utils::crc16>{}}
+        : rx_parser{std::in_place_index<0>, rx_header{}, key, other_all{}};
+
+    std::visit([](auto& p){
+        p.set_max_frame_size(header_size + rx_frame_size + sizeof(utils::crc16::value_type));
+    }, parser);
+    return parser;
 }
 
 roboctrl::awaitable<void> serial::send(uint8_t id,byte_span data)
 {
-    co_await asio::async_write(port_, asio::buffer(data), asio::use_awaitable);
+    if(data.size() > 0xffff)
+        throw std::invalid_argument(std::format("serial frame of {} bytes is too long", data.size()));
+
+    if(tx_.push(id, data))
+        record_tx_drop();
+
+    co_return;
+}
+
+roboctrl::awaitable<void> serial::send_batch(std::span<const std::pair<key_type,byte_span>> frames)
+{
+    for(auto& [id, data] : frames){
+        if(data.size() > 0xffff)
+            throw std::invalid_argument(std::format("serial frame of {} bytes is too long", data.size()));
+    }
+
+    for(auto& [id, data] : frames){
+        if(tx_.push(id, data))
+            record_tx_drop();
+    }
+
+    co_return;
 }
 
-roboctrl::awaitable<void> serial::read_n(size_t size){
-    co_await asio::async_read(
-        port_,
-        asio::buffer(buffer_),
-        asio::transfer_exactly(size),
-        asio::use_awaitable
-    );
+roboctrl::awaitable<void> serial::write(std::span<tx_queue<key_type>::entry> batch)
+{
+    std::size_t total = 0;
+    for(auto& entry : batch)
+        total += tx_header_size + entry.data.size() + sizeof(utils::crc16::value_type);
+
+    tx_buffer_.resize(total);
+    auto out = tx_buffer_.data();
+
+    for(auto& entry : batch){
+        auto frame = out;
+        auto size = static_cast<std::uint16_t>(entry.data.size());
+
+        std::memcpy(out, &header_magic, sizeof(header_magic));
+        out[2] = static_cast<std::byte>(entry.key);
+        std::memcpy(out + 3, &size, sizeof(size));
+        out += tx_header_size;
+
+        if(size > 0)
+            std::memcpy(out, entry.data.data(), size);
+        out += size;
+
+        auto crc = utils::crc16::compute(std::span<const std::byte>{frame, out});
+        std::memcpy(out, &crc, sizeof(crc));
+        out += sizeof(crc);
+    }
+
+    try{
+        co_await asio::async_write(port_, asio::buffer(tx_buffer_.data(), total), asio::use_awaitable);
+    }
+    catch(const std::exception& e){
+        record_send_error();
+        log_warn("failed to write serial port: {}", e.what());
+        co_return;
+    }
+
+    for(auto& entry : batch)
+        record_tx(entry.key, entry.data.size());
 }
 
 roboctrl::awaitable<void> serial::task()
 {
     while(true){
-        uint16_t header = co_await read<uint16_t>();
-        
-        if(header == 0xAA55){
-            uint8_t key = co_await read<uint8_t>();
-            auto len = package_size(key);
-            co_await read_n(len);
-            dispatch(key, byte_span{buffer_.data(),len});
-        }
+        auto n = co_await port_.async_read_some(asio::buffer(rx_buffer_), asio::use_awaitable);
+        auto now = utils::now();
+
+        auto failures = parse(byte_span{rx_buffer_.data(), n}, [&](key_type key, byte_span data){
+            dispatch(key, data, now);
+        });
+
+        if(failures)
+            record_parse_failure(failures);
     }
 }
 
+void serial::receive(rx_thread<rx_frame,64>& rx)
+{
+    auto n = ::read(port_.native_handle(), rx_buffer_.data(), rx_buffer_.size());
+    if(n <= 0){
+        if(n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            log_warn("failed to read serial port: {}", std::strerror(errno));
+        return;
+    }
+
+    auto now = utils::now();
+
+    auto failures = parse(byte_span{rx_buffer_.data(), static_cast<std::size_t>(n)}, [&](key_type key, byte_span data){
+        if(auto slot = rx.prepare()){
+            slot->key = key;
+            slot->size = data.size();
+            slot->time = now;
+            std::memcpy(slot->data.data(), data.data(), data.size());
+            rx.commit();
+        }
+    });
+
+    if(failures)
+        rx_failures_.fetch_add(failures, std::memory_order_relaxed);
+}
@@ -0,0 +1,45 @@
+#include "io/serial_termios.h"
+
+// 这个文件不能包含 asio，见 serial_termios.h
+#include <asm/termbits.h>
+#include <linux/serial.h>
+#include <sys/ioctl.h>
+
+using namespace roboctrl::io;
+
+bool details::set_custom_baud_rate(int fd, unsigned int baud_rate){
+    struct termios2 tio{};
+    if(::ioctl(fd, TCGETS2, &tio) < 0)
+        return false;
+
+    tio.c_cflag &= ~CBAUD;
+    tio.c_cflag |= BOTHER;
+    tio.c_ispeed = baud_rate;
+    tio.c_ospeed = baud_rate;
+
+    return ::ioctl(fd, TCSETS2, &tio) == 0;
+}
+
+bool details::set_low_latency(int fd){
+    struct serial_struct info{};
+    if(::ioctl(fd, TIOCGSERIAL, &info) < 0)
+        return false;
+
+    info.flags |= ASYNC_LOW_LATENCY;
+    return ::ioctl(fd, TIOCSSERIAL, &info) == 0;
+}
+
+bool details::set_read_timing(int fd, std::uint8_t vmin, std::uint8_t vtime){
+    struct termios2 tio{};
+    if(::ioctl(fd, TCGETS2, &tio) < 0)
+        return false;
+
+    tio.c_cc[VMIN] = vmin;
+    tio.c_cc[VTIME] = vtime;
+
+    return ::ioctl(fd, TCSETS2, &tio) == 0;
+}
+
+bool details::set_exclusive(int fd){
+    return ::ioctl(fd, TIOCEXCL) == 0;
+}
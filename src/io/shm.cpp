@@ -0,0 +1,278 @@
+#include "io/shm.h"
+#include "core/async.hpp"
+#include "io/base.hpp"
+#include "utils/utils.hpp"
+
+#include <bit>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace roboctrl::io;
+
+/// @brief 记录头（数据长度）的字节数
+static constexpr std::size_t __record_header = sizeof(std::uint32_t);
+/// @brief 数据区末尾放不下记录时写入的标记，读到它就从数据区开头继续读
+static constexpr std::uint32_t __wrap_marker = 0xffffffff;
+
+static constexpr std::size_t __record_size(std::size_t size){
+    return (__record_header + size + 7) & ~std::size_t{7};
+}
+
+// 共享内存跨进程使用，不能用 FUTEX_PRIVATE_FLAG
+static void __futex_wait(std::atomic<std::uint32_t>& word,std::uint32_t expected){
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+}
+
+static void __futex_wake(std::atomic<std::uint32_t>& word){
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+shm::shm(info_type info)
+    : bare_io_base{},
+    info_{info},
+    timer_{roboctrl::executor(), asio::steady_timer::time_point::max()}
+{
+    try{
+        map();
+    }
+    catch(...){
+        unmap();
+        throw;
+    }
+
+    waiter_ = std::thread([this]{ wait(); });
+    roboctrl::spawn(task());
+}
+
+shm::~shm()
+{
+    if(waiter_.joinable()){
+        stopping_.store(true, std::memory_order_seq_cst);
+        rx_->seq.fetch_add(1, std::memory_order_seq_cst);
+        __futex_wake(rx_->seq);
+        waiter_.join();
+    }
+
+    unmap();
+}
+
+void shm::map()
+{
+    std::string path{info_.path};
+
+    if(info_.create){
+        if(!std::has_single_bit(info_.capacity) || info_.capacity < 4096)
+            throw std::invalid_argument(std::format("capacity of shared memory {} must be a power of 2 and at least 4096", path));
+
+        // 上次运行留下的共享内存可能还被旧的对端映射着，删掉重建，不和它共用队列
+        ::shm_unlink(path.c_str());
+        fd_ = ::shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    }
+    else
+        fd_ = ::shm_open(path.c_str(), O_RDWR | O_CLOEXEC, 0);
+
+    if(fd_ < 0)
+        throw std::runtime_error(std::format("failed to open shared memory {}: {}", path, std::strerror(errno)));
+
+    if(info_.create){
+        capacity_ = info_.capacity;
+        map_size_ = sizeof(details::shm_header) + 2 * capacity_;
+        if(::ftruncate(fd_, static_cast<off_t>(map_size_)) < 0)
+            throw std::runtime_error(std::format("failed to resize shared memory {}: {}", path, std::strerror(errno)));
+    }
+    else{
+        struct stat st;
+        if(::fstat(fd_, &st) < 0 || static_cast<std::size_t>(st.st_size) < sizeof(details::shm_header))
+            throw std::runtime_error(std::format("shared memory {} is not initialized", path));
+        map_size_ = st.st_size;
+    }
+
+    map_ = ::mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if(map_ == MAP_FAILED)
+        throw std::runtime_error(std::format("failed to map shared memory {}: {}", path, std::strerror(errno)));
+
+    // ftruncate() 得到的内存全是 0，原子变量的初始值正好是 0，创建方只需要写入容量和 magic
+    auto header = static_cast<details::shm_header*>(map_);
+    if(info_.create){
+        header->capacity = capacity_;
+        header->magic.store(details::shm_header::magic_value, std::memory_order_release);
+    }
+    else{
+        if(header->magic.load(std::memory_order_acquire) != details::shm_header::magic_value)
+            throw std::runtime_error(std::format("shared memory {} is not initialized", path));
+
+        capacity_ = header->capacity;
+        if(!std::has_single_bit(capacity_) || sizeof(details::shm_header) + 2 * capacity_ > map_size_)
+            throw std::runtime_error(std::format("shared memory {} is corrupted", path));
+    }
+
+    auto data = static_cast<std::byte*>(map_) + sizeof(details::shm_header);
+    int side = info_.create ? 0 : 1;
+    tx_ = &header->rings[side];
+    rx_ = &header->rings[1 - side];
+    tx_data_ = data + side * capacity_;
+    rx_data_ = data + (1 - side) * capacity_;
+}
+
+void shm::unmap()
+{
+    if(map_ && map_ != MAP_FAILED)
+        ::munmap(map_, map_size_);
+    map_ = nullptr;
+
+    if(fd_ >= 0){
+        ::close(fd_);
+        fd_ = -1;
+
+        if(info_.create)
+            ::shm_unlink(std::string{info_.path}.c_str());
+    }
+}
+
+roboctrl::awaitable<void> shm::send(byte_span data)
+{
+    co_await send(std::span<const byte_span>{&data, 1});
+}
+
+roboctrl::awaitable<void> shm::send(std::span<const byte_span> parts)
+{
+    std::size_t size = 0;
+    for(auto part : parts)
+        size += part.size();
+
+    if(size > max_frame()){
+        record_send_error();
+        throw std::length_error(std::format("shared memory frame of {} bytes exceeds {} bytes", size, max_frame()));
+    }
+
+    if(write(parts, size))
+        record_tx(size);
+    else
+        record_tx_drop();
+
+    co_return;
+}
+
+bool shm::write(std::span<const byte_span> parts, std::size_t size)
+{
+    auto head = tx_->head.load(std::memory_order_relaxed);
+    auto offset = head & (capacity_ - 1);
+    auto record = __record_size(size);
+    auto pad = capacity_ - offset < record ? capacity_ - offset : 0;
+
+    if(head + pad + record - tx_tail_cache_ > capacity_){
+        tx_tail_cache_ = tx_->tail.load(std::memory_order_acquire);
+        if(head + pad + record - tx_tail_cache_ > capacity_)
+            return false;
+    }
+
+    if(pad){
+        std::memcpy(tx_data_ + offset, &__wrap_marker, sizeof(__wrap_marker));
+        head += pad;
+        offset = 0;
+    }
+
+    auto length = static_cast<std::uint32_t>(size);
+    std::memcpy(tx_data_ + offset, &length, sizeof(length));
+    auto out = tx_data_ + offset + __record_header;
+    for(auto part : parts){
+        if(!part.empty())
+            std::memcpy(out, part.data(), part.size());
+        out += part.size();
+    }
+
+    tx_->head.store(head + record, std::memory_order_release);
+
+    // 与等待线程构成 Dekker 式的同步：对端要么看到新的 seq 不再睡眠，要么这里看到 waiters 不为 0 去唤醒它
+    tx_->seq.fetch_add(1, std::memory_order_seq_cst);
+    if(tx_->waiters.load(std::memory_order_seq_cst))
+        __futex_wake(tx_->seq);
+
+    return true;
+}
+
+void shm::drain()
+{
+    auto tail = rx_->tail.load(std::memory_order_relaxed);
+    auto head = rx_->head.load(std::memory_order_acquire);
+    auto now = utils::now();
+
+    while(tail != head){
+        auto offset = tail & (capacity_ - 1);
+        std::uint32_t length;
+        std::memcpy(&length, rx_data_ + offset, sizeof(length));
+
+        if(length == __wrap_marker){
+            tail += capacity_ - offset;
+            continue;
+        }
+
+        // 对端是另一个进程，长度不可信，越界时丢掉队列中剩下的全部数据
+        if(length > max_frame() || __record_size(length) > capacity_ - offset){
+            record_parse_failure();
+            log_warn("corrupted record in shared memory {}, dropping queued data", info_.path);
+            tail = head;
+            break;
+        }
+
+        dispatch(byte_span{rx_data_ + offset + __record_header, length}, now);
+        tail += __record_size(length);
+        rx_->tail.store(tail, std::memory_order_release);
+    }
+
+    rx_->tail.store(tail, std::memory_order_release);
+}
+
+roboctrl::awaitable<void> shm::task()
+{
+    while(true){
+        drain();
+
+        waiting_.store(true, std::memory_order_seq_cst);
+        if(rx_->head.load(std::memory_order_seq_cst) != rx_->tail.load(std::memory_order_relaxed)){
+            waiting_.store(false, std::memory_order_relaxed);
+            continue;
+        }
+
+        asio::error_code ec;
+        timer_.expires_at(asio::steady_timer::time_point::max());
+        co_await timer_.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+    }
+}
+
+void shm::wait()
+{
+    ::pthread_setname_np(::pthread_self(), "shm_waiter");
+
+    if(info_.cpu >= 0){
+        ::cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(info_.cpu, &set);
+        ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+    }
+
+    auto seen = rx_->seq.load(std::memory_order_acquire);
+    while(!stopping_.load(std::memory_order_acquire)){
+        rx_->waiters.fetch_add(1, std::memory_order_seq_cst);
+        if(rx_->seq.load(std::memory_order_seq_cst) == seen)
+            __futex_wait(rx_->seq, seen);
+        rx_->waiters.fetch_sub(1, std::memory_order_relaxed);
+
+        seen = rx_->seq.load(std::memory_order_acquire);
+
+        // 接收任务正在读数据时不需要唤醒，它读完后会再检查一次队列
+        if(waiting_.exchange(false, std::memory_order_seq_cst))
+            asio::post(timer_.get_executor(), [this]{ timer_.cancel(); });
+    }
+}
@@ -0,0 +1,103 @@
+#include "io/stats_reporter.h"
+#include "core/async.hpp"
+#include "core/multiton.hpp"
+#include "io/base.hpp"
+#include "io/can.h"
+#include "io/frame_pool.h"
+#include "io/serial.h"
+#include "io/shm.h"
+#include "io/tcp.h"
+#include "io/udp.h"
+#include "utils/utils.hpp"
+
+#include <chrono>
+#include <format>
+#include <string>
+
+using namespace roboctrl::io;
+
+static std::string __format_key(const auto& key){
+    if constexpr (std::integral<std::remove_cvref_t<decltype(key)>>)
+        return std::format("{:#x}", key);
+    else
+        return std::format("{}", key);
+}
+
+static inline auto __us(std::chrono::nanoseconds ns){
+    return std::chrono::duration_cast<std::chrono::microseconds>(ns).count();
+}
+
+bool stats_reporter::init(const info_type& info){
+    info_ = info;
+    last_dump_ = utils::now();
+    roboctrl::spawn(task());
+    return true;
+}
+
+roboctrl::awaitable<void> stats_reporter::task(){
+    while(true){
+        co_await roboctrl::wait_for(info_.period);
+        dump();
+    }
+}
+
+template<typename T>
+void stats_reporter::report(T& io,double elapsed){
+    const auto& stats = io.stats();
+    auto name = io.desc();
+    auto& last = last_[name];
+
+    auto rate = [&](std::uint64_t now, std::uint64_t before){
+        return static_cast<double>(now - before) / elapsed;
+    };
+
+    log_info("{}: rx {:.0f} fps {:.1f} kB/s, tx {:.0f} fps {:.1f} kB/s, unknown {}, parse failures {}, send errors {}, tx dropped {}, rx dropped {}, latency mean {}us p99 {}us max {}us",
+        name,
+        rate(stats.traffic.rx_frames, last.rx_frames),
+        rate(stats.traffic.rx_bytes, last.rx_bytes) / 1000.0,
+        rate(stats.traffic.tx_frames, last.tx_frames),
+        rate(stats.traffic.tx_bytes, last.tx_bytes) / 1000.0,
+        stats.unknown_keys,
+        stats.parse_failures,
+        stats.send_errors,
+        stats.tx_dropped,
+        stats.rx_dropped,
+        __us(stats.latency.mean()),
+        __us(stats.latency.percentile(0.99)),
+        __us(stats.latency.max())
+    );
+
+    if constexpr (std::same_as<T, can>)
+        log_info("{}: bus load {:.1f}%", name, io.load() * 100);
+
+    if constexpr (keyed_io<T>){
+        io.for_each_key_stats([&](const auto& key, const traffic_stats& traffic){
+            log_debug("  {} key {}: rx {} frames {} B, tx {} frames {} B",
+                name, __format_key(key), traffic.rx_frames, traffic.rx_bytes, traffic.tx_frames, traffic.tx_bytes);
+        });
+    }
+
+    last = stats.traffic;
+}
+
+void stats_reporter::dump(){
+    auto now = utils::now();
+    auto elapsed = std::chrono::duration<double>(now - last_dump_).count();
+    last_dump_ = now;
+
+    if(elapsed <= 0)
+        return;
+
+    for(auto& [key, io] : roboctrl::instances<can>())
+        report(*io, elapsed);
+    for(auto& [key, io] : roboctrl::instances<serial>())
+        report(*io, elapsed);
+    for(auto& [key, io] : roboctrl::instances<udp>())
+        report(*io, elapsed);
+    for(auto& [key, io] : roboctrl::instances<tcp>())
+        report(*io, elapsed);
+    for(auto& [key, io] : roboctrl::instances<shm>())
+        report(*io, elapsed);
+
+    log_info("{}", frame_pool::local().desc());
+}
@@ -2,45 +2,129 @@
 #include "core/async.hpp"
 #include "io/base.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <format>
+#include <stdexcept>
 #include <utility>
 
 using namespace roboctrl::io;
 
+/// @brief 每次读取前保证接收缓冲中至少有这么多空闲空间
+static constexpr std::size_t __min_read_size = 1024;
+
 tcp::tcp(info_type info)
     : bare_io_base{},
       socket_{roboctrl::executor()},
-      info_{std::move(info)}
+      info_{std::move(info)},
+      tx_{info_.tx}
 {
     auto endpoint = asio::ip::tcp::endpoint(
-        asio::ip::make_address(info.address),
-        info.port
+        asio::ip::make_address(info_.address),
+        info_.port
     );
     socket_.connect(endpoint);
+    gather_.reserve(tx_.capacity());
     
     roboctrl::spawn(task());
+    roboctrl::spawn(tx_.run([this](auto batch){ return write(batch); }));
 }
 
-tcp::tcp(asio::ip::tcp::socket socket, std::string key)
+tcp::tcp(asio::ip::tcp::socket socket, std::string key, stream_framing framing, std::size_t max_frame, tx_options tx)
     : bare_io_base{},
       socket_{std::move(socket)},
-      info_{.name = std::move(key), .address = std::string{}, .port = 0}
+      info_{.name = std::move(key), .address = std::string{}, .port = 0, .tx = tx, .framing = framing, .max_frame = max_frame},
+      tx_{info_.tx}
 {
     auto remote = socket_.remote_endpoint();
     info_.address = remote.address().to_string();
     info_.port = remote.port();
+    gather_.reserve(tx_.capacity());
+
+    roboctrl::spawn(tx_.run([this](auto batch){ return write(batch); }));
 }
 
 roboctrl::awaitable<void> tcp::send(byte_span data)
 {
-    co_await asio::async_write(socket_, asio::buffer(data), asio::use_awaitable);
+    co_await send(std::span<const byte_span>{&data, 1});
+}
+
+roboctrl::awaitable<void> tcp::send(std::span<const byte_span> parts)
+{
+    // 前缀作为第一段，和数据一起拼进同一个帧缓冲
+    auto dropped = with_length_prefix(info_.framing, parts, [this](std::span<const byte_span> buffers){
+        return tx_.push({}, buffers);
+    });
+
+    if(dropped)
+        record_tx_drop();
+
+    co_return;
+}
+
+roboctrl::awaitable<void> tcp::write(std::span<tx_queue<>::entry> batch)
+{
+    gather_.clear();
+    for(auto& entry : batch)
+        gather_.push_back(asio::buffer(entry.data.span()));
+
+    try{
+        co_await asio::async_write(socket_, gather_, asio::use_awaitable);
+    }
+    catch(const std::exception& e){
+        record_send_error();
+        log_warn("failed to write tcp socket: {}", e.what());
+        co_return;
+    }
+
+    for(auto& entry : batch)
+        record_tx(entry.data.size());
 }
 
 roboctrl::awaitable<void> tcp::task()
+{
+    co_await read();
+    close();
+
+    // 写协程可能还挂在这次写入上，等它看到队列关闭后返回，连接才能析构
+    tx_.close();
+    while(!tx_.stopped())
+        co_await roboctrl::yield();
+
+    on_close_();
+}
+
+void tcp::close()
+{
+    asio::error_code ec;
+    socket_.close(ec);
+}
+
+roboctrl::awaitable<void> tcp::read()
 {
     while(true){
-        auto bytes = co_await socket_.async_read_some(asio::buffer(buffer_), asio::use_awaitable);
-        dispatch(buffer_);
+        asio::error_code ec;
+        auto bytes = co_await socket_.async_read_some(asio::buffer(rx_.prepare(__min_read_size)), asio::redirect_error(asio::use_awaitable, ec));
+        if(ec){
+            if(ec == asio::error::eof || ec == asio::error::operation_aborted)
+                log_info("connection closed");
+            else
+                log_warn("connection closed: {}", ec.message());
+            co_return;
+        }
+        rx_.commit(bytes);
+
+        try{
+            auto used = decode_frames(info_.framing, rx_.data(), info_.max_frame, [this](byte_span frame){
+                dispatch(frame);
+            });
+            rx_.consume(used);
+        }
+        catch(const std::length_error& e){
+            record_parse_failure();
+            log_warn("closing connection: {}", e.what());
+            co_return;
+        }
     }
 }
 
@@ -57,6 +141,8 @@ tcp_server::tcp_server(info_type info)
     acceptor_.set_option(asio::ip::tcp::acceptor::reuse_address(true));
     acceptor_.bind(endpoint);
     acceptor_.listen();
+
+    roboctrl::spawn(task());
 }
 
 roboctrl::awaitable<void> tcp_server::task()
@@ -66,14 +152,53 @@ roboctrl::awaitable<void> tcp_server::task()
         co_await acceptor_.async_accept(socket, asio::use_awaitable);
         auto connection = make_connection(std::move(socket));
         connections_.push_back(connection);
-        roboctrl::spawn(connection->task());
+        roboctrl::spawn(serve(connection));
         on_connect_(connection);
     }
 }
 
+roboctrl::awaitable<void> tcp_server::serve(std::shared_ptr<tcp> connection)
+{
+    co_await connection->task();
+    std::erase(connections_, connection);
+}
+
+roboctrl::awaitable<void> tcp_server::broadcast(byte_span data)
+{
+    if(connections_.empty())
+        co_return;
+
+    auto frame = with_length_prefix(info_.framing, std::span<const byte_span>{&data, 1}, [](std::span<const byte_span> parts){
+        std::size_t size = 0;
+        for(auto part : parts)
+            size += part.size();
+
+        auto buffer = frame_pool::local().acquire(size);
+        auto out = buffer.data();
+        for(auto part : parts){
+            if(!part.empty())
+                std::memcpy(out, part.data(), part.size());
+            out += part.size();
+        }
+        return buffer;
+    });
+
+    for(auto& connection : connections_){
+        if(!connection->is_open())
+            continue;
+
+        // 连接在 serve() 中等接收任务返回后才移除，这里只关闭，不改动 connections_
+        if(connection->tx_.push({}, frame)){
+            connection->record_tx_drop();
+            log_warn("dropping slow client {}", connection->desc());
+            connection->close();
+        }
+    }
+}
+
 std::shared_ptr<tcp> tcp_server::make_connection(asio::ip::tcp::socket socket)
 {
     auto remote = socket.remote_endpoint();
-    auto key = std::format("{}:{}:{}:{}", info_.name, remote.address().to_string(), remote.port(), connections_.size());
-    return std::make_shared<tcp>(std::move(socket), std::move(key));
+    auto key = std::format("{}:{}:{}:{}", info_.name, remote.address().to_string(), remote.port(), accepted_++);
+    return std::make_shared<tcp>(std::move(socket), std::move(key), info_.framing, info_.max_frame, info_.tx);
 }
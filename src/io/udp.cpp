@@ -1,29 +1,240 @@
 #include "io/udp.h"
 #include "core/async.hpp"
 #include "io/base.hpp"
+#include "utils/utils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
 
 using namespace roboctrl::io;
 
+/// @brief 一个 UDP 报文（包括 GRO 合并后的报文）的最大长度
+static constexpr std::size_t __max_udp_payload = 65535;
+/// @brief 一个 GSO 报文最多包含的分段数，与内核的 UDP_MAX_SEGMENTS 相同
+static constexpr std::size_t __max_gso_segments = 64;
+static constexpr std::size_t __control_size = CMSG_SPACE(sizeof(int));
+
+/**
+ * 从控制消息中取出 GRO 的分段长度，没有合并时返回 0。
+ */
+static std::size_t __gro_segment_size(::msghdr& hdr){
+    for(auto cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)){
+        if(cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO){
+            int size;
+            std::memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+            return size > 0 ? size : 0;
+        }
+    }
+    return 0;
+}
+
 udp::udp(info_type info)
     : bare_io_base{},
     socket_{roboctrl::executor()},
-    info_{info}
+    info_{info},
+    tx_{info.tx}
 {
     auto endpoint = asio::ip::udp::endpoint(asio::ip::make_address(info.address),info.port);
     socket_.connect(endpoint);
-    
+
+    int fd = socket_.native_handle();
+    int enable = 1;
+
+    if(info_.gro && ::setsockopt(fd, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) < 0){
+        log_warn("UDP GRO not supported: {}", std::strerror(errno));
+        info_.gro = false;
+    }
+
+    // 设置一次默认分段长度来探测内核是否支持 GSO，实际的分段长度在每次发送时通过控制消息指定
+    int segment = 0;
+    if(info_.gso && ::setsockopt(fd, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)) < 0){
+        log_warn("UDP GSO not supported: {}", std::strerror(errno));
+        info_.gso = false;
+    }
+
+    // GRO 合并后的报文可能远大于单个报文，每个槽位都要能放下
+    auto rx_batch = std::max<std::size_t>(info_.rx_batch, 1);
+    rx_slot_size_ = info_.gro ? __max_udp_payload : std::max<std::size_t>(info_.max_datagram, 1);
+    rx_buffer_.resize(rx_batch * rx_slot_size_);
+    rx_iovs_.resize(rx_batch);
+    rx_msgs_.resize(rx_batch);
+    rx_control_.resize(rx_batch * __control_size);
+
+    for(std::size_t i = 0; i < rx_batch; ++i){
+        rx_iovs_[i] = {.iov_base = rx_buffer_.data() + i * rx_slot_size_, .iov_len = rx_slot_size_};
+        rx_msgs_[i].msg_hdr.msg_iov = &rx_iovs_[i];
+        rx_msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    auto depth = tx_.capacity();
+    tx_iovs_.resize(depth);
+    tx_msgs_.resize(depth);
+    tx_counts_.resize(depth);
+    tx_control_.resize(depth * __control_size);
+
     roboctrl::spawn(task());
+    roboctrl::spawn(tx_.run([this](auto batch){ return write(batch); }));
 }
 
 roboctrl::awaitable<void> udp::send(byte_span data)
 {
-    co_await socket_.async_send(asio::buffer(data),asio::use_awaitable);
+    if(tx_.push({}, data))
+        record_tx_drop();
+
+    co_return;
+}
+
+roboctrl::awaitable<void> udp::send(std::span<const byte_span> parts)
+{
+    if(tx_.push({}, parts))
+        record_tx_drop();
+
+    co_return;
+}
+
+std::size_t udp::fill_message(std::span<tx_queue<>::entry> batch, std::size_t begin, std::size_t index)
+{
+    auto& hdr = tx_msgs_[index].msg_hdr;
+    hdr = {};
+    hdr.msg_iov = &tx_iovs_[begin];
+
+    auto segment = batch[begin].data.size();
+    std::size_t count = 1;
+    std::size_t total = segment;
+    tx_iovs_[begin] = {.iov_base = batch[begin].data.data(), .iov_len = segment};
+
+    // GSO 要求除最后一段外每段长度相同，最后一段可以更短
+    if(info_.gso && segment > 0){
+        while(begin + count < batch.size() && count < __max_gso_segments){
+            auto size = batch[begin + count].data.size();
+            if(size == 0 || size > segment || total + size > __max_udp_payload)
+                break;
+
+            tx_iovs_[begin + count] = {.iov_base = batch[begin + count].data.data(), .iov_len = size};
+            total += size;
+            ++count;
+
+            if(size < segment)
+                break;
+        }
+    }
+
+    hdr.msg_iovlen = count;
+
+    if(count > 1){
+        hdr.msg_control = tx_control_.data() + index * __control_size;
+        hdr.msg_controllen = CMSG_SPACE(sizeof(std::uint16_t));
+        auto cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+        auto size = static_cast<std::uint16_t>(segment);
+        std::memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+    }
+
+    return count;
+}
+
+roboctrl::awaitable<void> udp::write(std::span<tx_queue<>::entry> batch)
+{
+    std::size_t messages = 0;
+    for(std::size_t i = 0; i < batch.size(); i += tx_counts_[messages++])
+        tx_counts_[messages] = fill_message(batch, i, messages);
+
+    // 一次 sendmmsg() 写出全部报文，内核发送缓冲满时等待可写后继续发送剩下的报文
+    std::size_t sent = 0;
+    std::size_t entry = 0;
+    while(sent < messages){
+        int n = ::sendmmsg(socket_.native_handle(), tx_msgs_.data() + sent, messages - sent, MSG_DONTWAIT);
+
+        if(n < 0){
+            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS){
+                try{
+                    co_await socket_.async_wait(asio::ip::udp::socket::wait_write, asio::use_awaitable);
+                    continue;
+                }
+                catch(const std::exception& e){
+                    log_warn("failed to wait for udp socket: {}", e.what());
+                }
+            }
+            else
+                log_warn("failed to send udp datagram: {}", std::strerror(errno));
+
+            // 跳过发送失败的这个报文
+            record_send_error();
+            entry += tx_counts_[sent++];
+            continue;
+        }
+
+        for(int i = 0; i < n; ++i, ++sent){
+            for(std::size_t j = 0; j < tx_counts_[sent]; ++j)
+                record_tx(batch[entry++].data.size());
+        }
+    }
 }
 
 roboctrl::awaitable<void> udp::task()
 {
+    int fd = socket_.native_handle();
+
     while(true){
-        auto bytes = co_await socket_.async_receive(asio::buffer(buffer_),asio::use_awaitable);
-        dispatch(byte_span{buffer_.data(),bytes});
+        co_await socket_.async_wait(asio::ip::udp::socket::wait_read, asio::use_awaitable);
+
+        for(std::size_t i = 0; i < rx_msgs_.size(); ++i){
+            auto& hdr = rx_msgs_[i].msg_hdr;
+            hdr.msg_control = info_.gro ? rx_control_.data() + i * __control_size : nullptr;
+            hdr.msg_controllen = info_.gro ? __control_size : 0;
+            hdr.msg_flags = 0;
+        }
+
+        int n = ::recvmmsg(fd, rx_msgs_.data(), rx_msgs_.size(), MSG_DONTWAIT, nullptr);
+        if(n < 0){
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+                log_warn("failed to receive udp datagrams: {}", std::strerror(errno));
+            continue;
+        }
+
+        auto now = utils::now();
+
+        for(int i = 0; i < n; ++i){
+            auto& msg = rx_msgs_[i];
+            if(msg.msg_hdr.msg_flags & MSG_TRUNC){
+                record_parse_failure();
+                log_warn("udp datagram longer than max_datagram ({} bytes) dropped", info_.max_datagram);
+                continue;
+            }
+
+            auto data = byte_span{rx_buffer_.data() + i * rx_slot_size_, msg.msg_len};
+
+            // GRO 合并的报文按分段长度切回原来的报文
+            auto segment = info_.gro ? __gro_segment_size(msg.msg_hdr) : 0;
+            if(segment == 0)
+                segment = data.size();
+
+            // 开启 GRO 时槽位足够大，不会出现 MSG_TRUNC，这里按 max_datagram 检查每个报文
+            if(segment > info_.max_datagram){
+                record_parse_failure((data.size() + segment - 1) / segment);
+                log_warn("udp datagram longer than max_datagram ({} bytes) dropped", info_.max_datagram);
+                continue;
+            }
+
+            for(std::size_t offset = 0; offset < data.size(); offset += segment)
+                dispatch(data.subspan(offset, std::min(segment, data.size() - offset)), now);
+
+            if(data.empty())
+                dispatch(data, now);
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,282 @@
+#include "io/uds.h"
+#include "core/async.hpp"
+#include "io/base.hpp"
+#include "utils/utils.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace roboctrl::io;
+
+/// @brief 每次读取前保证接收缓冲中至少有这么多空闲空间
+static constexpr std::size_t __min_read_size = 1024;
+
+/**
+ * 由套接字路径得到通用协议的端点。
+ */
+template<typename Protocol>
+static typename Protocol::endpoint __endpoint(const std::string& path){
+    return typename Protocol::endpoint{asio::local::stream_protocol::endpoint{path}};
+}
+
+uds::uds(info_type info)
+    : bare_io_base{},
+      info_{std::move(info)},
+      stream_{roboctrl::executor()},
+      seqpacket_{roboctrl::executor()},
+      tx_{info_.tx}
+{
+    if(info_.mode == uds_mode::stream)
+        stream_.connect(__endpoint<asio::generic::stream_protocol>(info_.path));
+    else{
+        seqpacket_.connect(__endpoint<asio::generic::seq_packet_protocol>(info_.path));
+        packet_.resize(info_.max_frame);
+    }
+    gather_.reserve(tx_.capacity());
+
+    roboctrl::spawn(task());
+    roboctrl::spawn(tx_.run([this](auto batch){ return write(batch); }));
+}
+
+uds::uds(stream_socket socket, std::string key, std::string path, stream_framing framing, std::size_t max_frame)
+    : bare_io_base{},
+      info_{.name = std::move(key), .path = std::move(path), .mode = uds_mode::stream, .framing = framing, .max_frame = max_frame},
+      stream_{std::move(socket)},
+      seqpacket_{roboctrl::executor()}
+{
+    gather_.reserve(tx_.capacity());
+
+    roboctrl::spawn(tx_.run([this](auto batch){ return write(batch); }));
+}
+
+uds::uds(seqpacket_socket socket, std::string key, std::string path, std::size_t max_frame)
+    : bare_io_base{},
+      info_{.name = std::move(key), .path = std::move(path), .mode = uds_mode::seqpacket, .max_frame = max_frame},
+      stream_{roboctrl::executor()},
+      seqpacket_{std::move(socket)}
+{
+    packet_.resize(info_.max_frame);
+
+    roboctrl::spawn(tx_.run([this](auto batch){ return write(batch); }));
+}
+
+roboctrl::awaitable<void> uds::send(byte_span data)
+{
+    co_await send(std::span<const byte_span>{&data, 1});
+}
+
+roboctrl::awaitable<void> uds::send(std::span<const byte_span> parts)
+{
+    // seqpacket 模式本身保留消息边界，不需要长度前缀
+    auto framing = info_.mode == uds_mode::stream ? info_.framing : stream_framing::none;
+    auto dropped = with_length_prefix(framing, parts, [this](std::span<const byte_span> buffers){
+        return tx_.push({}, buffers);
+    });
+
+    if(dropped)
+        record_tx_drop();
+
+    co_return;
+}
+
+roboctrl::awaitable<void> uds::write(std::span<tx_queue<>::entry> batch)
+{
+    if(!is_open())
+        co_return;
+
+    try{
+        if(info_.mode == uds_mode::stream){
+            gather_.clear();
+            for(auto& entry : batch)
+                gather_.push_back(asio::buffer(entry.data.span()));
+
+            co_await asio::async_write(stream_, gather_, asio::use_awaitable);
+
+            for(auto& entry : batch)
+                record_tx(entry.data.size());
+        }
+        else{
+            // 每一帧都要单独发送，直接在非阻塞的套接字上发，缓冲满时才等待可写，不必每一帧都回到事件循环
+            seqpacket_.non_blocking(true);
+            for(auto& entry : batch){
+                while(true){
+                    asio::error_code ec;
+                    seqpacket_.send(asio::buffer(entry.data.span()), 0, ec);
+                    if(!ec)
+                        break;
+                    if(ec != asio::error::would_block){
+                        record_send_error();
+                        log_warn("failed to write unix socket: {}", ec.message());
+                        co_return;
+                    }
+                    co_await seqpacket_.async_wait(seqpacket_socket::wait_write, asio::use_awaitable);
+                }
+                record_tx(entry.data.size());
+            }
+        }
+    }
+    catch(const std::exception& e){
+        record_send_error();
+        log_warn("failed to write unix socket: {}", e.what());
+    }
+}
+
+roboctrl::awaitable<void> uds::task()
+{
+    if(info_.mode == uds_mode::stream)
+        co_await read_stream();
+    else
+        co_await read_seqpacket();
+
+    close();
+
+    // 写协程可能还挂在这次写入上，等它看到队列关闭后返回，连接才能析构
+    tx_.close();
+    while(!tx_.stopped())
+        co_await roboctrl::yield();
+
+    on_close_();
+}
+
+roboctrl::awaitable<void> uds::read_stream()
+{
+    while(true){
+        asio::error_code ec;
+        auto bytes = co_await stream_.async_read_some(asio::buffer(rx_.prepare(__min_read_size)), asio::redirect_error(asio::use_awaitable, ec));
+        if(ec){
+            if(ec != asio::error::eof)
+                log_warn("failed to read unix socket: {}", ec.message());
+            co_return;
+        }
+        rx_.commit(bytes);
+
+        try{
+            auto used = decode_frames(info_.framing, rx_.data(), info_.max_frame, [this](byte_span frame){
+                dispatch(frame);
+            });
+            rx_.consume(used);
+        }
+        catch(const std::length_error& e){
+            record_parse_failure();
+            log_warn("closing connection: {}", e.what());
+            co_return;
+        }
+    }
+}
+
+roboctrl::awaitable<void> uds::read_seqpacket()
+{
+    // 与发送一样，可读后在非阻塞的套接字上一直读到没有消息为止
+    seqpacket_.non_blocking(true);
+
+    while(true){
+        asio::error_code ec;
+        co_await seqpacket_.async_wait(seqpacket_socket::wait_read, asio::redirect_error(asio::use_awaitable, ec));
+        if(ec){
+            log_warn("failed to wait for unix socket: {}", ec.message());
+            co_return;
+        }
+
+        auto now = utils::now();
+        while(true){
+            asio::socket_base::message_flags flags = 0;
+            auto bytes = seqpacket_.receive(asio::buffer(packet_), 0, flags, ec);
+            if(ec == asio::error::would_block)
+                break;
+            if(ec){
+                if(ec != asio::error::eof)
+                    log_warn("failed to read unix socket: {}", ec.message());
+                co_return;
+            }
+
+            // SOCK_SEQPACKET 在对端关闭后读到 0 字节，因此 0 字节的消息也会被当作连接关闭
+            if(bytes == 0)
+                co_return;
+
+            if(flags & MSG_TRUNC){
+                record_parse_failure();
+                log_warn("message longer than max_frame ({} bytes) dropped", info_.max_frame);
+                continue;
+            }
+
+            dispatch(byte_span{packet_.data(), bytes}, now);
+        }
+    }
+}
+
+void uds::close()
+{
+    asio::error_code ec;
+    if(info_.mode == uds_mode::stream)
+        stream_.close(ec);
+    else
+        seqpacket_.close(ec);
+}
+
+uds_server::uds_server(info_type info)
+    : info_{std::move(info)},
+      stream_acceptor_{roboctrl::executor()},
+      seqpacket_acceptor_{roboctrl::executor()}
+{
+    // 上次运行留下的套接字文件会让 bind() 失败
+    ::unlink(info_.path.c_str());
+
+    if(info_.mode == uds_mode::stream)
+        listen(stream_acceptor_);
+    else
+        listen(seqpacket_acceptor_);
+
+    roboctrl::spawn(task());
+}
+
+uds_server::~uds_server()
+{
+    ::unlink(info_.path.c_str());
+}
+
+template<typename Protocol>
+void uds_server::listen(acceptor_type<Protocol>& acceptor)
+{
+    auto endpoint = __endpoint<Protocol>(info_.path);
+    acceptor.open(endpoint.protocol());
+    acceptor.bind(endpoint);
+    acceptor.listen();
+}
+
+roboctrl::awaitable<void> uds_server::task()
+{
+    if(info_.mode == uds_mode::stream)
+        co_await accept(stream_acceptor_);
+    else
+        co_await accept(seqpacket_acceptor_);
+}
+
+template<typename Protocol>
+roboctrl::awaitable<void> uds_server::accept(acceptor_type<Protocol>& acceptor)
+{
+    while(true){
+        typename Protocol::socket socket{roboctrl::executor()};
+        co_await acceptor.async_accept(socket, asio::use_awaitable);
+
+        auto key = std::format("{}:{}", info_.name, accepted_++);
+        std::shared_ptr<uds> connection;
+        if constexpr (std::same_as<Protocol, asio::generic::stream_protocol>)
+            connection = std::make_shared<uds>(std::move(socket), std::move(key), info_.path, info_.framing, info_.max_frame);
+        else
+            connection = std::make_shared<uds>(std::move(socket), std::move(key), info_.path, info_.max_frame);
+
+        connections_.push_back(connection);
+        roboctrl::spawn(serve(connection));
+        on_connect_(connection);
+    }
+}
+
+roboctrl::awaitable<void> uds_server::serve(std::shared_ptr<uds> connection)
+{
+    co_await connection->task();
+    std::erase(connections_, connection);
+}
@@ -9,6 +9,8 @@
 #include "device/motor/dji.h"
 #include "io/can.h"
 #include "io/serial.h"
+#include "io/stats_reporter.h"
+#include "io/capture.h"
 #include <concepts>
 #include <cxxopts.hpp>
 #include <print>
@@ -55,7 +57,10 @@ int main(int argc,char** argv){
     options.add_options()
         ("h,help", "Print help")
         ("l,log", "Log level", cxxopts::value<std::string>()->default_value("info"))
-        ("f,filter","Filter for logger",cxxopts::value<std::string>()->default_value(""));
+        ("f,filter","Filter for logger",cxxopts::value<std::string>()->default_value(""))
+        ("s,stats","Dump IO statistics every N seconds",cxxopts::value<int>())
+        ("c,capture","Capture all received IO data to file",cxxopts::value<std::string>())
+        ("r,replay","Replay captured IO data from file",cxxopts::value<std::string>());
     
     auto result = options.parse(argc, argv);
 
@@ -88,6 +93,24 @@ int main(int argc,char** argv){
         return -1;
     }
 
+    if(result.count("stats")){
+        roboctrl::init(io::stats_reporter::info_type{
+            .period = std::chrono::seconds{result["stats"].as<int>()}
+        });
+    }
+
+    if(result.count("capture")){
+        roboctrl::init(io::capture::info_type{
+            .path = result["capture"].as<std::string>()
+        });
+    }
+
+    if(result.count("replay")){
+        roboctrl::init(io::replay::info_type{
+            .path = result["replay"].as<std::string>()
+        });
+    }
+
     LOG_INFO("Initiation finished.");
 
     roboctrl::get<ctrl::robot>().set_velocity(0.1,0.1);
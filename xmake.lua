@@ -45,3 +45,35 @@ target("gkd-roboctrl")
     if is_mode("debug") then
         add_defines("DEBUG")
     end
+
+-- 基准测试，默认不编译，见 bench/bench.hpp
+-- xmake f -m release && xmake build bench_callback && xmake run bench_callback
+function bench_target(name, files, cxxflags)
+    target("bench_" .. name)
+        set_kind("binary")
+        set_default(false)
+        set_group("bench")
+        add_files("bench/" .. name .. ".cpp", "src/core/*.cpp")
+        if files then
+            add_files(files)
+        end
+        if cxxflags then
+            add_cxxflags(cxxflags)
+        end
+        add_includedirs("include")
+        add_packages("asio")
+    target_end()
+end
+
+bench_target("callback")
+bench_target("parser")
+bench_target("scatter_gather")
+bench_target("framing", {"src/io/tcp.cpp", "src/io/frame_pool.cpp"})
+bench_target("shm", {"src/io/shm.cpp", "src/io/udp.cpp", "src/io/frame_pool.cpp"})
+
+-- CRC32 的 PCLMUL 路径需要显式开启
+if is_arch("x86_64") then
+    bench_target("crc", nil, {"-mpclmul", "-msse4.1"})
+else
+    bench_target("crc")
+end